@@ -0,0 +1,111 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "bundle.h"
+
+asset_bundle::~asset_bundle()
+{
+    if (m_addr)
+        munmap(m_addr, m_size);
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+bool asset_bundle::open(const char *path, int &err)
+{
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        err = errno;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(bundle_header))
+    {
+        err = EINVAL;
+        close(fd);
+        return false;
+    }
+    //文件内容的对齐要满足映射和mincore的页对齐要求
+    if (BUNDLE_ALIGN % sysconf(_SC_PAGESIZE) != 0)
+    {
+        err = EINVAL;
+        close(fd);
+        return false;
+    }
+    char *addr = (char *)mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        err = errno;
+        close(fd);
+        return false;
+    }
+
+    //校验头部和各段的范围，之后的查找不再做边界检查
+    const bundle_header *h = (const bundle_header *)addr;
+    size_t size = st.st_size;
+    bool ok = memcmp(h->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0 &&
+              h->version == BUNDLE_VERSION && h->size == size &&
+              h->slot_count && (h->slot_count & (h->slot_count - 1)) == 0 && h->count < h->slot_count &&
+              h->records_offset + (uint64_t)h->count * sizeof(bundle_record) <= size &&
+              h->slots_offset + (uint64_t)h->slot_count * sizeof(uint32_t) <= size &&
+              h->names_offset <= size;
+    const bundle_record *records = (const bundle_record *)(addr + h->records_offset);
+    const uint32_t *slots = (const uint32_t *)(addr + h->slots_offset);
+    for (uint32_t i = 0; ok && i < h->count; ++i)
+    {
+        const bundle_record &r = records[i];
+        ok = h->names_offset + r.name_offset + r.name_len <= size && r.offset + r.size <= size &&
+             r.offset % BUNDLE_ALIGN == 0 && memchr(r.etag, '\0', sizeof(r.etag)) &&
+             memchr(r.last_modified, '\0', sizeof(r.last_modified)) &&
+             memchr(r.content_type, '\0', sizeof(r.content_type));
+        for (int e = 0; ok && e < BUNDLE_ENCODINGS; ++e)
+            ok = !r.variant_offset[e] ||
+                 (r.variant_offset[e] + r.variant_size[e] <= size && r.variant_offset[e] % BUNDLE_ALIGN == 0);
+    }
+    for (uint32_t i = 0; ok && i < h->slot_count; ++i)
+        ok = slots[i] <= h->count;
+    if (!ok)
+    {
+        err = EINVAL;
+        munmap(addr, size);
+        close(fd);
+        return false;
+    }
+    //包内文件连续存放，整体顺序预读一次即可预热所有文件
+    madvise(addr, size, MADV_WILLNEED);
+
+    m_fd = fd;
+    m_addr = addr;
+    m_size = size;
+    m_header = h;
+    m_records = records;
+    m_slots = slots;
+    return true;
+}
+
+std::string_view asset_bundle::name(int index) const
+{
+    const bundle_record &r = m_records[index];
+    return std::string_view(m_addr + m_header->names_offset + r.name_offset, r.name_len);
+}
+
+int asset_bundle::find(std::string_view name) const
+{
+    if (!m_addr)
+        return -1;
+    uint32_t hash = bundle_hash(name);
+    uint32_t mask = m_header->slot_count - 1;
+    for (uint32_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        uint32_t slot = m_slots[i];
+        if (!slot)
+            return -1;
+        const bundle_record &r = m_records[slot - 1];
+        if (r.hash == hash && this->name(slot - 1) == name)
+            return slot - 1;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string_view>
+#include "bundle_format.h"
+
+// 只读映射的静态资源包
+// 启动时整体映射并校验，之后的查找只是一次哈希加线性探测，不涉及任何文件系统调用
+class asset_bundle
+{
+public:
+    asset_bundle() : m_fd(-1), m_addr(0), m_size(0), m_header(0), m_records(0), m_slots(0) {}
+    ~asset_bundle();
+
+    //打开并校验资源包，失败时返回false，err为errno或EINVAL(格式不对)
+    bool open(const char *path, int &err);
+    bool loaded() const { return m_addr != 0; }
+
+    //按相对网站根目录的路径查找，返回记录下标，找不到返回-1
+    int find(std::string_view name) const;
+
+    int count() const { return m_header ? (int)m_header->count : 0; }
+    const bundle_record &record(int index) const { return m_records[index]; }
+    std::string_view name(int index) const;
+    char *data(uint64_t offset) const { return m_addr + offset; }
+    int fd() const { return m_fd; }
+
+private:
+    int m_fd;
+    char *m_addr;
+    size_t m_size;
+    const bundle_header *m_header;
+    const bundle_record *m_records;
+    const uint32_t *m_slots;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef BUNDLE_FORMAT_H
+#define BUNDLE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string_view>
+
+// 静态资源包的文件格式，打包工具tools/bundle_pack.cpp与服务器共用
+// 布局：bundle_header | bundle_record * count | uint32_t槽 * slot_count | 文件名 | 按BUNDLE_ALIGN对齐的文件内容
+// 槽中存放记录下标+1，0为空槽，按文件名哈希线性探测；所有偏移都是相对包起始位置的字节数
+// 数值按本机字节序存储，包只能在同一种架构上使用
+
+const char BUNDLE_MAGIC[8] = {'W', 'S', 'B', 'U', 'N', 'D', 'L', 'E'};
+const uint32_t BUNDLE_VERSION = 1;
+const uint64_t BUNDLE_ALIGN = 4096;     //文件内容按页对齐，可以直接映射、sendfile和mincore
+const int BUNDLE_ENCODINGS = 2;         //压缩版本数，下标与CONTENT_ENCODING一致：0为gzip，1为br
+
+struct bundle_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;             //文件数
+    uint32_t slot_count;        //哈希槽数，2的幂
+    uint32_t reserved;
+    uint64_t records_offset;
+    uint64_t slots_offset;
+    uint64_t names_offset;
+    uint64_t size;              //整个包的字节数，用于校验是否完整
+};
+
+struct bundle_record
+{
+    uint64_t name_offset;       //相对names_offset
+    uint32_t name_len;
+    uint32_t hash;
+    uint64_t offset;            //文件内容
+    uint64_t size;
+    uint64_t variant_offset[BUNDLE_ENCODINGS];  //压缩版本，没有时为0
+    uint64_t variant_size[BUNDLE_ENCODINGS];
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    char etag[64];              //按内容哈希生成，以\0结尾
+    char last_modified[32];
+    char content_type[64];
+    uint32_t compressible;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(bundle_header) == 56, "bundle_header layout changed");
+static_assert(sizeof(bundle_record) == 248, "bundle_record layout changed");
+
+//文件名哈希，FNV-1a
+inline uint32_t bundle_hash(std::string_view name)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#endif
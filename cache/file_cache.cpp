@@ -0,0 +1,636 @@
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zlib.h>
+#include <charconv>
+#include "file_cache.h"
+#include "../log/log.h"
+#include "../http/mime_types.h"
+
+//各编码对应的预压缩文件后缀
+static const char *encoding_suffix[ENCODING_COUNT] = {".gz", ".br"};
+
+//新建条目的公共初始化，调用者持有唯一的引用
+static void reset_entry(file_entry *entry)
+{
+    entry->refs.store(1, memory_order_relaxed);
+    entry->resident.store(false, memory_order_relaxed);
+    entry->base = 0;
+    entry->cached = false;
+    entry->compressible = false;
+    entry->variant_checked = 0;
+    for (int i = 0; i < ENCODING_COUNT; ++i)
+        entry->variant[i] = NULL;
+    for (int i = 0; i < 2; ++i)
+    {
+        entry->response[i].store(NULL, memory_order_relaxed);
+        entry->response_len[i] = 0;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+//生成条目的ETag与Last-Modified，加载时计算一次，之后每个应答直接拷贝
+static void make_validators(file_entry *entry)
+{
+    const struct stat &st = entry->st;
+    char *p = entry->etag;
+    char *end = entry->etag + sizeof(entry->etag);
+    unsigned long long mtime = (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    *p++ = '"';
+    p = to_chars(p, end, (unsigned long long)st.st_ino, 16).ptr;
+    *p++ = '-';
+    p = to_chars(p, end, mtime, 16).ptr;
+    *p++ = '-';
+    p = to_chars(p, end, (unsigned long long)st.st_size, 16).ptr;
+    *p++ = '"';
+    *p = '\0';
+
+    struct tm tm;
+    gmtime_r(&st.st_mtime, &tm);
+    strftime(entry->last_modified, sizeof(entry->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+//压缩版本是同一资源的另一种表示，沿用原文件的类型和校验器，ETag以编码区分，如"...-gz"
+static void derive_from_base(file_entry *v, const file_entry *base, CONTENT_ENCODING encoding)
+{
+    size_t len = strlen(base->etag) - 1;
+    memcpy(v->etag, base->etag, len);
+    v->etag[len] = '-';
+    strcpy(v->etag + len + 1, encoding_suffix[encoding] + 1);
+    strcat(v->etag, "\"");
+    memcpy(v->last_modified, base->last_modified, sizeof(v->last_modified));
+    v->content_type = base->content_type;
+}
+
+//根据1分钟平均负载选择压缩级别，CPU空闲时压得更狠，繁忙时只求快
+static int compress_level()
+{
+    double load = 0;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&load, 1) != 1 || cpus <= 0)
+        return Z_DEFAULT_COMPRESSION;
+    double per_cpu = load / cpus;
+    if (per_cpu < 0.5)
+        return 9;
+    if (per_cpu < 1.0)
+        return 6;
+    return 1;
+}
+
+file_cache::file_cache()
+{
+    m_head = NULL;
+    m_tail = NULL;
+    m_bytes = 0;
+    m_max_bytes = 0;
+    m_max_file_size = 0;
+    m_inotify_fd = -1;
+    m_enabled = false;
+    m_close_log = 1;
+    m_generation.store(0);
+}
+
+file_cache::~file_cache()
+{
+    m_mutex.lock();
+    invalidate_all();
+    m_mutex.unlock();
+    if (m_inotify_fd != -1)
+        close(m_inotify_fd);
+}
+
+bool file_cache::init(const char *doc_root, size_t max_bytes, size_t max_file_size, int close_log)
+{
+    m_max_bytes = max_bytes;
+    m_max_file_size = max_file_size;
+    m_close_log = close_log;
+    if (0 == max_bytes)
+        return true;
+
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd == -1)
+    {
+        LOG_ERROR("inotify_init1 failed, errno is:%d, file cache disabled", errno);
+        return false;
+    }
+    m_enabled = true;
+    watch_dir(doc_root);
+    return true;
+}
+
+//为目录添加监视，同一目录重复添加会返回相同的watch描述符，调用者持有m_mutex
+bool file_cache::watch_dir(const string &path)
+{
+    int wd = inotify_add_watch(m_inotify_fd, path.c_str(),
+                               IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE | IN_CREATE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd == -1)
+    {
+        //目录不存在时文件也不存在，随后的加载会返回404，不必记录
+        if (errno != ENOENT && errno != ENOTDIR)
+            LOG_ERROR("inotify_add_watch %s failed, errno is:%d", path.c_str(), errno);
+        return false;
+    }
+    m_watches[wd] = path;
+    m_watched_dirs[path] = wd;
+    return true;
+}
+
+//确保文件所在目录已被监视，必须在加载文件之前完成，否则加载与添加监视之间的修改不会产生事件
+bool file_cache::watch_parent(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash == path)
+        return true;
+    string dir(path, slash - path);
+    m_mutex.lock();
+    bool watched = m_watched_dirs.count(dir) || watch_dir(dir);
+    m_mutex.unlock();
+    return watched;
+}
+
+//监视已被内核移除(目录被删除或移走)，之后该目录中的文件重新加载时会再次添加
+void file_cache::unwatch(int wd)
+{
+    m_watches.erase(wd);
+    for (unordered_map<string, int>::iterator d = m_watched_dirs.begin(); d != m_watched_dirs.end();)
+    {
+        if (d->second == wd)
+            d = m_watched_dirs.erase(d);
+        else
+            ++d;
+    }
+}
+
+file_entry *file_cache::lookup(const char *path)
+{
+    if (!m_enabled)
+        return NULL;
+    m_mutex.lock();
+    unordered_map<string_view, file_entry *>::iterator it = m_entries.find(path);
+    if (it == m_entries.end())
+    {
+        m_mutex.unlock();
+        return NULL;
+    }
+    file_entry *entry = it->second;
+    //移到LRU表头
+    unlink(entry);
+    insert(entry);
+    entry->refs.fetch_add(1, memory_order_relaxed);
+    m_mutex.unlock();
+    return entry;
+}
+
+file_entry *file_cache::acquire(const char *path, int &err)
+{
+    file_entry *entry = lookup(path);
+    if (entry)
+        return entry;
+
+    //未命中，在锁外打开并映射文件
+    //先监视所在目录再记录失效计数，期间若发生失效，加载到的内容可能已经过期，不放入缓存
+    //无法监视的目录中的文件照常返回，但不缓存
+    bool watched = m_enabled && watch_parent(path);
+    unsigned long generation = m_generation.load(memory_order_acquire);
+    entry = load(path, err);
+    if (!entry || !watched || (size_t)entry->st.st_size > m_max_file_size)
+        return entry;
+
+    m_mutex.lock();
+    if (generation != m_generation.load(memory_order_relaxed))
+    {
+        m_mutex.unlock();
+        return entry;
+    }
+    unordered_map<string_view, file_entry *>::iterator it = m_entries.find(entry->path);
+    if (it != m_entries.end())
+    {
+        //其他线程已经抢先加入，使用已有的条目
+        file_entry *existing = it->second;
+        existing->refs.fetch_add(1, memory_order_relaxed);
+        m_mutex.unlock();
+        release(entry);
+        return existing;
+    }
+    //缓存持有一个引用
+    entry->refs.fetch_add(1, memory_order_relaxed);
+    entry->cached = true;
+    m_entries[entry->path] = entry;
+    insert(entry);
+    m_bytes += entry->st.st_size;
+    //超出上限时从LRU表尾淘汰
+    while (m_bytes > m_max_bytes && m_tail && m_tail != entry)
+        evict(m_tail);
+    m_mutex.unlock();
+    return entry;
+}
+
+void file_cache::release(file_entry *entry)
+{
+    if (entry && entry->refs.fetch_sub(1, memory_order_acq_rel) == 1)
+        destroy(entry);
+}
+
+//打开并映射文件，同时完成存在性、权限和目录检查
+file_entry *file_cache::load(const char *path, int &err)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)
+    {
+        err = errno;
+        return NULL;
+    }
+    if (!(st.st_mode & S_IROTH))
+    {
+        err = EACCES;
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        err = EISDIR;
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        err = errno;
+        return NULL;
+    }
+    //能进入缓存的文件整体映射；更大的文件只保留描述符，避免每个连接占用与文件等大的地址空间
+    char *addr = NULL;
+    if (st.st_size > 0 && (size_t)st.st_size <= max(m_max_file_size, WINDOW_SIZE))
+    {
+        addr = (char *)mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            err = errno;
+            close(fd);
+            return NULL;
+        }
+        //提前发起异步预读，请求到达发送阶段时多半已经读入
+        madvise(addr, st.st_size, MADV_WILLNEED);
+    }
+    else if (st.st_size > 0)
+    {
+        //分段发送的大文件按顺序读取，加大内核的预读窗口
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    file_entry *entry = new file_entry;
+    entry->path = path;
+    entry->fd = fd;
+    entry->addr = addr;
+    entry->st = st;
+    reset_entry(entry);
+    const mime_type &mime = mime_lookup(entry->path);
+    entry->compressible = mime.compressible;
+    entry->content_type = mime.type;
+    make_validators(entry);
+    return entry;
+}
+
+bool file_cache::variant_ready(file_entry *base, unsigned encodings)
+{
+    m_mutex.lock();
+    bool ready = !base->cached || (base->variant_checked & encodings) == encodings;
+    m_mutex.unlock();
+    return ready;
+}
+
+file_entry *file_cache::acquire_variant(file_entry *base, CONTENT_ENCODING encoding)
+{
+    unsigned bit = 1u << encoding;
+    m_mutex.lock();
+    //未进入缓存的文件每次都要重新压缩，不值得
+    if (!base->cached)
+    {
+        m_mutex.unlock();
+        return NULL;
+    }
+    if (base->variant_checked & bit)
+    {
+        file_entry *v = base->variant[encoding];
+        if (v)
+            v->refs.fetch_add(1, memory_order_relaxed);
+        m_mutex.unlock();
+        return v;
+    }
+    unsigned long generation = m_generation.load(memory_order_relaxed);
+    m_mutex.unlock();
+
+    //首次请求，在锁外查找预压缩文件或进行压缩
+    file_entry *v = load_variant(base, encoding);
+
+    m_mutex.lock();
+    if (generation != m_generation.load(memory_order_relaxed) || !base->cached)
+    {
+        //期间发生过失效，结果只给本次请求使用
+        m_mutex.unlock();
+        return v;
+    }
+    if (base->variant_checked & bit)
+    {
+        //其他线程已经先完成，改用已有的版本
+        if (v)
+            release(v);
+        v = base->variant[encoding];
+        if (v)
+            v->refs.fetch_add(1, memory_order_relaxed);
+    }
+    else
+    {
+        base->variant_checked |= bit;
+        base->variant[encoding] = v;
+        if (v)
+        {
+            //base持有一个引用，压缩版本计入缓存总量
+            v->refs.fetch_add(1, memory_order_relaxed);
+            m_bytes += v->st.st_size;
+            while (m_bytes > m_max_bytes && m_tail && m_tail != base)
+                evict(m_tail);
+        }
+    }
+    m_mutex.unlock();
+    return v;
+}
+
+file_entry *file_cache::load_variant(file_entry *base, CONTENT_ENCODING encoding)
+{
+    int err = 0;
+    string path = base->path + encoding_suffix[encoding];
+    file_entry *v = load(path.c_str(), err);
+    //预压缩文件比原文件还旧，说明没有随原文件一起更新，不使用
+    if (v && v->st.st_mtime < base->st.st_mtime)
+    {
+        release(v);
+        v = NULL;
+    }
+    if (!v && ENCODING_GZIP == encoding && base->compressible)
+        v = compress(base);
+    if (v)
+        derive_from_base(v, base, encoding);
+    return v;
+}
+
+//在内存中生成gzip版本，压缩后体积缩小不足10%时放弃
+file_entry *file_cache::compress(file_entry *base)
+{
+    if (!base->addr || base->st.st_size < 256)
+        return NULL;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //windowBits加16表示输出gzip格式
+    if (deflateInit2(&zs, compress_level(), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+    uLong bound = deflateBound(&zs, base->st.st_size);
+    char *out = (char *)malloc(bound);
+    if (!out)
+    {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)base->addr;
+    zs.avail_in = base->st.st_size;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = bound;
+    int ret = deflate(&zs, Z_FINISH);
+    size_t len = zs.total_out;
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END || len >= (size_t)base->st.st_size * 9 / 10)
+    {
+        free(out);
+        return NULL;
+    }
+
+    file_entry *v = new file_entry;
+    v->path = base->path + encoding_suffix[ENCODING_GZIP];
+    v->fd = -1;
+    v->addr = (char *)realloc(out, len);
+    if (!v->addr)
+        v->addr = out;
+    v->st = base->st;
+    v->st.st_size = len;
+    reset_entry(v);
+    return v;
+}
+
+//为资源包中的每个文件建立常驻条目，条目指向包的映射，缓存持有的引用永不释放
+bool file_cache::open_bundle(const char *path)
+{
+    int err = 0;
+    if (!m_bundle.open(path, err))
+    {
+        LOG_ERROR("open bundle %s failed, errno is:%d", path, err);
+        return false;
+    }
+    for (int i = 0; i < m_bundle.count(); ++i)
+    {
+        const bundle_record &r = m_bundle.record(i);
+        file_entry *entry = new file_entry;
+        entry->path = m_bundle.name(i);
+        entry->fd = m_bundle.fd();
+        entry->addr = r.size ? m_bundle.data(r.offset) : NULL;
+        memset(&entry->st, 0, sizeof(entry->st));
+        entry->st.st_mode = S_IFREG | 0444;
+        entry->st.st_size = r.size;
+        entry->st.st_mtim.tv_sec = r.mtime_sec;
+        entry->st.st_mtim.tv_nsec = r.mtime_nsec;
+        reset_entry(entry);
+        entry->base = r.offset;
+        entry->cached = true;
+        entry->compressible = r.compressible;
+        entry->content_type = r.content_type;
+        memcpy(entry->etag, r.etag, sizeof(entry->etag));
+        memcpy(entry->last_modified, r.last_modified, sizeof(entry->last_modified));
+        //压缩版本在打包时已经确定，不再查找同目录文件或在线压缩
+        entry->variant_checked = (1u << ENCODING_COUNT) - 1;
+        for (int e = 0; e < ENCODING_COUNT && e < BUNDLE_ENCODINGS; ++e)
+        {
+            if (!r.variant_offset[e])
+                continue;
+            file_entry *v = new file_entry;
+            v->path = entry->path + encoding_suffix[e];
+            v->fd = m_bundle.fd();
+            v->addr = m_bundle.data(r.variant_offset[e]);
+            v->st = entry->st;
+            v->st.st_size = r.variant_size[e];
+            reset_entry(v);
+            v->base = r.variant_offset[e];
+            derive_from_base(v, entry, (CONTENT_ENCODING)e);
+            entry->variant[e] = v;
+        }
+        m_bundled.push_back(entry);
+    }
+    LOG_INFO("loaded bundle %s with %d files", path, m_bundle.count());
+    return true;
+}
+
+file_entry *file_cache::acquire_bundled(string_view name)
+{
+    int index = m_bundle.find(name);
+    if (index < 0)
+        return NULL;
+    file_entry *entry = m_bundled[index];
+    retain(entry);
+    return entry;
+}
+
+const char *file_cache::get_response(file_entry *entry, bool linger, size_t &len)
+{
+    const char *data = entry->response[linger].load(memory_order_acquire);
+    if (data)
+        len = entry->response_len[linger];
+    return data;
+}
+
+const char *file_cache::set_response(file_entry *entry, bool linger, char *data, size_t &len)
+{
+    m_mutex.lock();
+    char *existing = entry->response[linger].load(memory_order_relaxed);
+    if (existing)
+    {
+        m_mutex.unlock();
+        free(data);
+        len = entry->response_len[linger];
+        return existing;
+    }
+    entry->response_len[linger] = len;
+    entry->response[linger].store(data, memory_order_release);
+    m_mutex.unlock();
+    return data;
+}
+
+void file_cache::destroy(file_entry *entry)
+{
+    for (int i = 0; i < 2; ++i)
+        free(entry->response[i].load(memory_order_relaxed));
+    if (entry->fd == -1)
+    {
+        free(entry->addr);
+    }
+    else
+    {
+        if (entry->addr)
+            munmap(entry->addr, entry->st.st_size);
+        close(entry->fd);
+    }
+    delete entry;
+}
+
+//插入到LRU表头，调用者持有锁
+void file_cache::insert(file_entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = m_head;
+    if (m_head)
+        m_head->prev = entry;
+    m_head = entry;
+    if (!m_tail)
+        m_tail = entry;
+}
+
+//从LRU链表中摘除，调用者持有锁
+void file_cache::unlink(file_entry *entry)
+{
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        m_head = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        m_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+//将条目移出缓存并释放缓存持有的引用，调用者持有锁
+void file_cache::evict(file_entry *entry)
+{
+    unlink(entry);
+    m_entries.erase(entry->path);
+    m_bytes -= entry->st.st_size;
+    entry->cached = false;
+    for (int i = 0; i < ENCODING_COUNT; ++i)
+    {
+        if (entry->variant[i])
+        {
+            m_bytes -= entry->variant[i]->st.st_size;
+            release(entry->variant[i]);
+            entry->variant[i] = NULL;
+        }
+    }
+    entry->variant_checked = 0;
+    release(entry);
+}
+
+//使path对应的条目失效，调用者持有锁
+void file_cache::invalidate(const string &path)
+{
+    unordered_map<string_view, file_entry *>::iterator it = m_entries.find(path);
+    if (it != m_entries.end())
+    {
+        LOG_INFO("file cache invalidate %s", path.c_str());
+        evict(it->second);
+    }
+    //预压缩文件变化时，原文件条目记录的压缩版本也随之失效
+    for (int i = 0; i < ENCODING_COUNT; ++i)
+    {
+        size_t n = strlen(encoding_suffix[i]);
+        if (path.size() > n && path.compare(path.size() - n, n, encoding_suffix[i]) == 0)
+        {
+            invalidate(path.substr(0, path.size() - n));
+            break;
+        }
+    }
+}
+
+//清空缓存，调用者持有锁
+void file_cache::invalidate_all()
+{
+    while (m_head)
+        evict(m_head);
+}
+
+//读取inotify事件，使被修改的文件对应的条目失效
+void file_cache::handle_events()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (true)
+    {
+        ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+        m_mutex.lock();
+        m_generation.fetch_add(1, memory_order_release);
+        for (char *p = buf; p < buf + len;)
+        {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            //事件队列溢出或目录本身被移走，无法确定影响范围，全部失效
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            {
+                invalidate_all();
+                if (ev->mask & IN_IGNORED)
+                    unwatch(ev->wd);
+                continue;
+            }
+            if (ev->len == 0)
+                continue;
+            unordered_map<int, string>::iterator w = m_watches.find(ev->wd);
+            if (w != m_watches.end())
+                invalidate(w->second + "/" + ev->name);
+        }
+        m_mutex.unlock();
+    }
+}
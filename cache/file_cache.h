@@ -0,0 +1,135 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include "../lock/locker.h"
+#include "bundle.h"
+
+using namespace std;
+
+//内容编码，按优先级从低到高排列
+enum CONTENT_ENCODING
+{
+    ENCODING_GZIP = 0,
+    ENCODING_BR,
+    ENCODING_COUNT
+};
+
+//缓存中的一个文件：打开的描述符和整个文件的只读映射
+//条目由引用计数管理，缓存本身持有一个引用，被淘汰或失效后等最后一个使用者释放时才真正关闭
+//压缩版本同样用file_entry表示，挂在原文件条目下，由原文件条目持有
+struct file_entry
+{
+    string path;            //网站根目录拼接后的完整路径，也是缓存的键
+    int fd;                 //内存中压缩生成的版本为-1，addr由malloc分配
+    char *addr;             //整个文件的映射，空文件和超过WINDOW_SIZE的不缓存大文件为NULL，后者由发送方分段映射
+    off_t base;             //文件内容在fd中的起始偏移，只有资源包中的文件不为0
+    struct stat st;
+    char etag[64];          //强校验器，由inode、修改时间和大小生成，压缩版本在原文件的基础上加编码后缀
+    char last_modified[32]; //HTTP日期格式的修改时间，压缩版本与原文件相同
+    atomic<int> refs;
+    atomic<bool> resident;  //整体映射是否已确认全部在页缓存中，确认过之后不再检查
+    bool cached;            //是否仍挂在缓存中
+    bool compressible;      //是否为值得压缩的文本类型
+    string_view content_type;   //按扩展名确定的MIME类型，压缩版本与原文件相同
+    unsigned variant_checked;                   //已查找过的压缩版本，按1<<CONTENT_ENCODING置位
+    file_entry *variant[ENCODING_COUNT];        //压缩版本，不存在或压缩无收益时为NULL
+    atomic<char *> response[2];     //小文件预先生成的完整应答(头部+文件内容)，下标0为close，1为keep-alive
+    size_t response_len[2];
+    file_entry *prev;       //LRU链表，表头为最近使用
+    file_entry *next;
+};
+
+//静态文件缓存，单例
+//命中时只需在哈希表中查找并增加引用计数，不产生任何文件系统调用
+//通过inotify监视网站目录，文件被修改、删除或移动时使对应条目失效
+class file_cache
+{
+public:
+    //大文件分段发送的窗口大小，必须是页大小的整数倍
+    static constexpr size_t WINDOW_SIZE = 2 << 20;
+
+    static file_cache *get_instance()
+    {
+        static file_cache instance;
+        return &instance;
+    }
+
+    //max_bytes为缓存映射的总字节数上限，超过max_file_size的文件不缓存
+    bool init(const char *doc_root, size_t max_bytes, size_t max_file_size, int close_log);
+
+    //获取path对应的文件，成功返回已增加引用的条目，使用完必须调用release
+    //失败返回NULL，err为ENOENT、EACCES、EISDIR等
+    file_entry *acquire(const char *path, int &err);
+    //只在缓存中查找，未命中返回NULL，不访问文件系统
+    file_entry *lookup(const char *path);
+    void release(file_entry *entry);
+    //为已持有引用的条目再增加一个引用，交给其他线程使用
+    void retain(file_entry *entry) { entry->refs.fetch_add(1, memory_order_relaxed); }
+
+    //获取base的压缩版本，优先使用同目录下预压缩的.gz/.br文件
+    //没有预压缩文件的文本类型在首次请求时gzip压缩并缓存在内存中，压缩级别随CPU负载调整
+    //base必须是已持有引用的条目，没有可用版本时返回NULL
+    file_entry *acquire_variant(file_entry *base, CONTENT_ENCODING encoding);
+    //encodings(按1<<CONTENT_ENCODING置位)中的压缩版本是否都已确定，即acquire_variant不会再读盘或压缩
+    bool variant_ready(file_entry *base, unsigned encodings);
+
+    //取得entry预先生成的完整应答，linger区分keep-alive与close两个版本，尚未生成时返回NULL
+    const char *get_response(file_entry *entry, bool linger, size_t &len);
+    //挂上生成好的完整应答，data由缓存接管；其他线程已先挂上时释放data并返回已有的版本
+    //完整应答只对小文件生成且每个条目最多两份，不计入缓存容量
+    const char *set_response(file_entry *entry, bool linger, char *data, size_t &len);
+
+    bool enabled() const { return m_enabled; }
+
+    //加载打包好的静态资源包，包中的文件优先于网站目录中的同名文件
+    bool open_bundle(const char *path);
+    //按相对网站根目录的路径在资源包中查找，没有加载资源包或包中没有时返回NULL
+    //返回的条目与acquire一样需要release，压缩版本同样通过acquire_variant取得
+    file_entry *acquire_bundled(string_view name);
+
+    //inotify描述符，需要注册到epoll中，可读时调用handle_events
+    int inotify_fd() const { return m_inotify_fd; }
+    void handle_events();
+
+private:
+    file_cache();
+    ~file_cache();
+
+    file_entry *load(const char *path, int &err);
+    file_entry *load_variant(file_entry *base, CONTENT_ENCODING encoding);
+    file_entry *compress(file_entry *base);
+    bool watch_dir(const string &path);
+    bool watch_parent(const char *path);
+    void unwatch(int wd);
+    void insert(file_entry *entry);
+    void unlink(file_entry *entry);
+    void evict(file_entry *entry);
+    void invalidate(const string &path);
+    void invalidate_all();
+    void destroy(file_entry *entry);
+
+    locker m_mutex;
+    asset_bundle m_bundle;
+    vector<file_entry *> m_bundled;     //资源包中每个文件对应的条目，常驻且不计入缓存容量
+    unordered_map<string_view, file_entry *> m_entries;
+    unordered_map<int, string> m_watches;      //inotify watch描述符 -> 目录
+    unordered_map<string, int> m_watched_dirs; //已监视的目录 -> watch描述符，同一目录可能有多个写法
+    file_entry *m_head;
+    file_entry *m_tail;
+    atomic<unsigned long> m_generation;     //每批inotify事件加一
+    size_t m_bytes;             //当前缓存的映射字节数
+    size_t m_max_bytes;
+    size_t m_max_file_size;
+    int m_inotify_fd;
+    bool m_enabled;             //inotify不可用时不缓存，退化为每次打开文件
+    int m_close_log;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include "io_pool.h"
+#include "../log/log.h"
+
+io_pool::io_pool()
+{
+    m_thread_number = 0;
+    m_threads = NULL;
+    m_notify[0] = m_notify[1] = -1;
+    m_close_log = 1;
+}
+
+io_pool::~io_pool()
+{
+    //线程是脱离的，进程退出时随之结束
+    delete[] m_threads;
+}
+
+bool io_pool::init(int thread_number, int close_log)
+{
+    m_close_log = close_log;
+    if (thread_number <= 0)
+        return true;
+
+    //读端非阻塞，主循环每次读空；写端阻塞，管道满时I/O线程等待主循环取走
+    if (pipe2(m_notify, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("io pool pipe failed, errno is:%d", errno);
+        return false;
+    }
+    fcntl(m_notify[0], F_SETFL, fcntl(m_notify[0], F_GETFL) | O_NONBLOCK);
+
+    m_threads = new pthread_t[thread_number];
+    for (int i = 0; i < thread_number; ++i)
+    {
+        if (pthread_create(m_threads + i, NULL, worker, this) != 0 || pthread_detach(m_threads[i]) != 0)
+        {
+            LOG_ERROR("io pool thread create failed");
+            break;
+        }
+        ++m_thread_number;
+    }
+    return m_thread_number > 0;
+}
+
+bool io_pool::submit(const io_request &request)
+{
+    if (!enabled())
+        return false;
+    m_queuelocker.lock();
+    m_queue.push_back(request);
+    m_queuelocker.unlock();
+    m_queuestat.post();
+    return true;
+}
+
+int io_pool::completed(io_done *done, int max)
+{
+    ssize_t ret = read(m_notify[0], done, sizeof(io_done) * max);
+    if (ret <= 0)
+        return 0;
+    return ret / sizeof(io_done);
+}
+
+void *io_pool::worker(void *arg)
+{
+    io_pool *pool = (io_pool *)arg;
+    pool->run();
+    return pool;
+}
+
+void io_pool::run()
+{
+    //读出的内容只为填充页缓存，每个线程一块临时缓冲区
+    char *buf = new char[READ_CHUNK];
+    while (true)
+    {
+        m_queuestat.wait();
+        m_queuelocker.lock();
+        if (m_queue.empty())
+        {
+            m_queuelocker.unlock();
+            continue;
+        }
+        io_request request = m_queue.front();
+        m_queue.pop_front();
+        m_queuelocker.unlock();
+
+        //readahead只把读请求排入队列就返回，这里用pread真正读一遍，返回时内容已在页缓存中
+        //失败或文件被截短时不影响发送，只是发送线程自己去读
+        off_t pos = request.entry->base + request.offset;
+        size_t left = request.len;
+        while (left > 0)
+        {
+            ssize_t n = pread(request.entry->fd, buf, min(left, READ_CHUNK), pos);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                LOG_WARN("prefetch %s failed, errno is:%d", request.entry->path.c_str(), errno);
+            if (n <= 0)
+                break;
+            pos += n;
+            left -= n;
+        }
+        file_cache::get_instance()->release(request.entry);
+
+        io_done done = {request.sockfd, request.ticket};
+        while (write(m_notify[1], &done, sizeof(done)) < 0 && errno == EINTR)
+            ;
+    }
+}
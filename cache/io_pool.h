@@ -0,0 +1,72 @@
+#ifndef IO_POOL_H
+#define IO_POOL_H
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <list>
+#include "../lock/locker.h"
+#include "file_cache.h"
+
+// 磁盘预读线程池，单例
+// 待发送的文件内容不在页缓存中时，直接writev/sendfile会让发送线程阻塞在磁盘读上
+// proactor模式下这个线程就是主循环，一个冷文件会拖住所有连接
+// 因此把这段内容交给这里的少量线程读入页缓存，完成后通过管道通知主循环恢复发送
+
+//一次预读请求，entry上持有一个引用，完成后由I/O线程释放
+struct io_request
+{
+    file_entry *entry;
+    off_t offset;
+    size_t len;
+    int sockfd;             //发起请求的连接
+    unsigned ticket;        //连接的请求序号，连接关闭或复用后不再匹配，完成通知被丢弃
+};
+
+//写入通知管道的完成记录，小于PIPE_BUF，写入是原子的
+struct io_done
+{
+    int sockfd;
+    unsigned ticket;
+};
+
+class io_pool
+{
+public:
+    static constexpr size_t READ_CHUNK = 128 * 1024;    //预读时每次pread的字节数
+
+    static io_pool *get_instance()
+    {
+        static io_pool instance;
+        return &instance;
+    }
+
+    //thread_number为0时不启用，发送线程直接读取
+    bool init(int thread_number, int close_log);
+    bool enabled() const { return m_thread_number > 0; }
+
+    //通知管道的读端，需要注册到epoll中，可读时调用completed
+    int notify_fd() const { return m_notify[0]; }
+
+    //提交预读请求，成功时entry的引用转交给I/O线程
+    bool submit(const io_request &request);
+
+    //取出已完成的请求，返回个数
+    int completed(io_done *done, int max);
+
+private:
+    io_pool();
+    ~io_pool();
+
+    static void *worker(void *arg);
+    void run();
+
+    int m_thread_number;
+    pthread_t *m_threads;
+    std::list<io_request> m_queue;
+    locker m_queuelocker;
+    sem m_queuestat;
+    int m_notify[2];
+    int m_close_log;
+};
+
+#endif
@@ -26,16 +26,57 @@ Config::Config()
     //线程池内的线程数量,默认8
     thread_num = 8;
 
+    //线程池伸缩时的线程数上限,默认0,线程数固定为thread_num
+    max_thread_num = 0;
+
     //关闭日志,默认不关闭
     close_log = 0;
 
     //并发模型,默认是proactor
     actor_model = 0;
+
+    //请求体超过1KB转存临时文件
+    upload_threshold = 1024;
+
+    //静态文件缓存,默认64MB,0表示不缓存
+    cache_size = 64;
+
+    //文件发送方式,0为mmap+writev,1为sendfile,默认writev
+    send_mode = 0;
+
+    //不超过16KB的文件缓存完整应答,0表示不缓存
+    prerender_size = 16384;
+
+    //Cache-Control规则,默认为空,只使用按类型的默认策略
+    cache_rules = "";
+
+    //磁盘预读线程数量,默认2,0表示不预读
+    io_threads = 2;
+
+    //静态资源包路径,默认为空,直接读取网站目录
+    bundle_path = "";
+
+    //不小于该KB数的应答体用MSG_ZEROCOPY发送,默认0,不使用
+    zerocopy_size = 0;
+
+    //线程池任务分派方式,默认0,共用一个队列;1,按连接固定线程并工作窃取;2,轮流分派并工作窃取
+    sched_mode = SCHED_SHARED;
+
+    //请求行和头部10秒内收完,请求体不低于1KB/s,长连接空闲15秒,发送停滞30秒后关闭连接
+    limits.header_timeout = 10;
+    limits.body_rate = 1024;
+    limits.idle_timeout = 15;
+    limits.write_timeout = 30;
+    //请求头最多64行,连同请求行不超过读缓冲区
+    limits.max_headers = 64;
+    limits.max_header_size = http_conn::READ_BUFFER_SIZE - 1;
+    //请求体最大8MB
+    limits.max_body_size = 8L << 20;
 }
 
 void Config::parse_arg(int argc, char*argv[]){
     int opt;
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:u:f:z:r:k:i:b:x:q:T:H:B:K:W:N:S:L:";
     //getopt()函数将传递给mian()函数的argc,argv作为参数，
     //同时接受字符串参数optstring -- optstring是由选项Option字母组成的字符串。
     while ((opt = getopt(argc, argv, str)) != -1)
@@ -72,6 +113,11 @@ void Config::parse_arg(int argc, char*argv[]){
             thread_num = atoi(optarg);
             break;
         }
+        case 'T':
+        {
+            max_thread_num = atoi(optarg);
+            break;
+        }
         case 'c':
         {
             close_log = atoi(optarg);
@@ -82,6 +128,87 @@ void Config::parse_arg(int argc, char*argv[]){
             actor_model = atoi(optarg);
             break;
         }
+        case 'u':
+        {
+            upload_threshold = atoi(optarg);
+            break;
+        }
+        case 'f':
+        {
+            cache_size = atoi(optarg);
+            break;
+        }
+        case 'z':
+        {
+            send_mode = atoi(optarg);
+            break;
+        }
+        case 'r':
+        {
+            prerender_size = atoi(optarg);
+            break;
+        }
+        case 'k':
+        {
+            cache_rules = optarg;
+            break;
+        }
+        case 'i':
+        {
+            io_threads = atoi(optarg);
+            break;
+        }
+        case 'b':
+        {
+            bundle_path = optarg;
+            break;
+        }
+        case 'x':
+        {
+            zerocopy_size = atoi(optarg);
+            break;
+        }
+        case 'q':
+        {
+            sched_mode = atoi(optarg);
+            break;
+        }
+        case 'H':
+        {
+            limits.header_timeout = atoi(optarg);
+            break;
+        }
+        case 'B':
+        {
+            limits.body_rate = atoi(optarg);
+            break;
+        }
+        case 'K':
+        {
+            limits.idle_timeout = atoi(optarg);
+            break;
+        }
+        case 'W':
+        {
+            limits.write_timeout = atoi(optarg);
+            break;
+        }
+        case 'N':
+        {
+            limits.max_headers = atoi(optarg);
+            break;
+        }
+        case 'S':
+        {
+            limits.max_header_size = atoi(optarg);
+            break;
+        }
+        case 'L':
+        {
+            //单位KB
+            limits.max_body_size = atol(optarg) << 10;
+            break;
+        }
         default:
             break;
         }
@@ -37,11 +37,44 @@ public:
     //线程池内的线程数量
     int thread_num;
 
+    //线程池伸缩时的线程数上限
+    int max_thread_num;
+
     //是否关闭日志
     int close_log;
 
     //并发模型选择
     int actor_model;
+
+    //请求体转存临时文件的阈值
+    int upload_threshold;
+
+    //静态文件缓存大小，单位MB
+    int cache_size;
+
+    //文件发送方式
+    int send_mode;
+
+    //缓存完整应答的小文件大小上限
+    int prerender_size;
+
+    //Cache-Control规则
+    string cache_rules;
+
+    //磁盘预读线程数量
+    int io_threads;
+
+    //静态资源包路径
+    string bundle_path;
+
+    //零拷贝发送的应答体大小下限，单位KB
+    int zerocopy_size;
+
+    //线程池的任务分派方式
+    int sched_mode;
+
+    //各阶段的超时与请求头限制
+    conn_limits limits;
 };
 
 #endif
\ No newline at end of file
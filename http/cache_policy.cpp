@@ -0,0 +1,80 @@
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "cache_policy.h"
+
+//文件名中带有内容指纹，如app.3f9a2b1c.js或logo-3f9a2b1c.png，内容变化时文件名随之变化，可以永久缓存
+static bool is_fingerprinted(string_view path)
+{
+    size_t slash = path.rfind('/');
+    string_view name = slash == string_view::npos ? path : path.substr(slash + 1);
+    size_t ext = name.rfind('.');
+    if (ext == string_view::npos)
+        return false;
+    //扩展名前以.或-分隔的一段至少8位十六进制数
+    size_t end = ext;
+    size_t start = end;
+    while (start > 0 && isxdigit((unsigned char)name[start - 1]))
+        --start;
+    return end - start >= 8 && start > 1 && (name[start - 1] == '.' || name[start - 1] == '-');
+}
+
+bool cache_policy::init(const char *rules)
+{
+    m_rules.clear();
+    if (!rules)
+        return true;
+
+    bool ok = true;
+    const char *p = rules;
+    while (*p)
+    {
+        size_t len = strcspn(p, ";");
+        string item(p, len);
+        p += len;
+        if (*p == ';')
+            ++p;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        if (eq == string::npos || eq == 0 || (item[0] != '/' && item[0] != '.'))
+        {
+            ok = false;
+            continue;
+        }
+        rule r;
+        r.prefix = item[0] == '/';
+        r.pattern = item.substr(r.prefix ? 0 : 1, r.prefix ? eq : eq - 1);
+        r.value = item.substr(eq + 1);
+        m_rules.push_back(r);
+    }
+    return ok;
+}
+
+string_view cache_policy::lookup(string_view path, const mime_type &mime) const
+{
+    for (size_t i = 0; i < m_rules.size(); ++i)
+    {
+        const rule &r = m_rules[i];
+        if (r.prefix)
+        {
+            if (path.substr(0, r.pattern.size()) == r.pattern)
+                return r.value;
+        }
+        else
+        {
+            size_t dot = path.rfind('.');
+            if (dot != string_view::npos && path.size() - dot - 1 == r.pattern.size() &&
+                strncasecmp(path.data() + dot + 1, r.pattern.c_str(), r.pattern.size()) == 0)
+                return r.value;
+        }
+    }
+
+    if (is_fingerprinted(path))
+        return "public, max-age=31536000, immutable";
+    //页面需要及时更新，每次都向服务器确认，依靠ETag得到304
+    if (mime.type.substr(0, 9) == "text/html")
+        return "no-cache";
+    return "public, max-age=3600";
+}
@@ -0,0 +1,44 @@
+#ifndef CACHE_POLICY_H
+#define CACHE_POLICY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mime_types.h"
+
+using namespace std;
+
+// Cache-Control策略，单例
+// 规则在启动时由命令行给出，格式为"模式=值;模式=值"，模式以/开头按路径前缀匹配，以.开头按扩展名匹配
+// 例如 "/static/=public, max-age=86400;.mp4=public, max-age=604800"
+// 查找顺序：配置的规则(按给出的顺序)、带内容指纹的文件、按类型的默认策略
+class cache_policy
+{
+public:
+    static cache_policy *get_instance()
+    {
+        static cache_policy instance;
+        return &instance;
+    }
+
+    //rules为NULL或空串时只使用默认策略，格式错误的规则被忽略并返回false
+    bool init(const char *rules);
+
+    //path为相对网站根目录的文件路径，返回值指向规则表中的常量或静态字符串
+    string_view lookup(string_view path, const mime_type &mime) const;
+
+private:
+    cache_policy() {}
+    ~cache_policy() {}
+
+    struct rule
+    {
+        bool prefix;        //true按路径前缀，false按扩展名
+        string pattern;
+        string value;
+    };
+
+    vector<rule> m_rules;
+};
+
+#endif
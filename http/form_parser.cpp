@@ -0,0 +1,156 @@
+#include "form_parser.h"
+#include <string.h>
+
+//  --------------SWAR辅助函数----------
+//一次检查8个字节，判断其中是否含有'%'或'+'
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+static inline uint64_t has_zero_byte(uint64_t v)
+{
+    return (v - ONES) & ~v & HIGHS;
+}
+
+static inline bool has_escape(uint64_t word)
+{
+    return has_zero_byte(word ^ (ONES * '%')) | has_zero_byte(word ^ (ONES * '+'));
+}
+
+static inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//  --------------成员函数---------------------
+void form_parser::clear()
+{
+    m_count = 0;
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+size_t form_parser::decode(char *data, size_t len)
+{
+    char *src = data;
+    char *dst = data;
+    char *end = data + len;
+
+    while (src < end)
+    {
+        //快速跳过不需要解码的8字节块，dst落后于src时整块前移
+        while (end - src >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, src, 8);
+            if (has_escape(word))
+                break;
+            if (dst != src)
+                memmove(dst, src, 8);
+            src += 8;
+            dst += 8;
+        }
+        if (src >= end)
+            break;
+
+        char c = *src;
+        if (c == '+')
+        {
+            *dst++ = ' ';
+            ++src;
+        }
+        else if (c == '%' && end - src >= 3 && hex_value(src[1]) >= 0 && hex_value(src[2]) >= 0)
+        {
+            *dst++ = (char)((hex_value(src[1]) << 4) | hex_value(src[2]));
+            src += 3;
+        }
+        else
+        {
+            *dst++ = c;
+            ++src;
+        }
+    }
+    return dst - data;
+}
+
+int form_parser::parse(char *data, size_t len)
+{
+    int added = 0;
+    char *end = data + len;
+    char *pair = data;
+
+    while (pair < end)
+    {
+        //每个字段以&分隔
+        char *amp = (char *)memchr(pair, '&', end - pair);
+        char *pair_end = amp ? amp : end;
+
+        if (pair_end != pair)
+        {
+            if (m_count >= MAX_FIELDS)
+                return -1;
+
+            char *eq = (char *)memchr(pair, '=', pair_end - pair);
+            char *key_end = eq ? eq : pair_end;
+            size_t key_len = decode(pair, key_end - pair);
+            size_t value_len = 0;
+            char *value = pair_end;
+            if (eq)
+            {
+                value = eq + 1;
+                value_len = decode(value, pair_end - value);
+            }
+
+            std::string_view key(pair, key_len);
+            int slot = find_slot(key);
+            if (0 == m_slots[slot])
+            {
+                m_fields[m_count].key = key;
+                m_fields[m_count].value = std::string_view(value, value_len);
+                m_slots[slot] = (uint8_t)(++m_count);
+                ++added;
+            }
+        }
+        pair = pair_end + 1;
+    }
+    return added;
+}
+
+bool form_parser::get(std::string_view key, std::string_view &value) const
+{
+    int slot = find_slot(key);
+    if (0 == m_slots[slot])
+        return false;
+    value = m_fields[m_slots[slot] - 1].value;
+    return true;
+}
+
+bool form_parser::has(std::string_view key) const
+{
+    return 0 != m_slots[find_slot(key)];
+}
+
+//FNV-1a
+uint32_t form_parser::hash(std::string_view key)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+//线性探测，返回key所在的槽或第一个空槽
+int form_parser::find_slot(std::string_view key) const
+{
+    int slot = hash(key) & (HASH_SIZE - 1);
+    while (m_slots[slot] && m_fields[m_slots[slot] - 1].key != key)
+        slot = (slot + 1) & (HASH_SIZE - 1);
+    return slot;
+}
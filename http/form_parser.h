@@ -0,0 +1,50 @@
+#ifndef FORM_PARSER_H
+#define FORM_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+// application/x-www-form-urlencoded 及查询串解析器
+// 直接在读缓冲区上原地解码，字段以string_view返回，不做任何堆分配
+class form_parser
+{
+public:
+    static const int MAX_FIELDS = 16;   //单个请求最多保存的字段数
+    static const int HASH_SIZE = 32;    //开放寻址哈希表大小，必须为2的幂且大于MAX_FIELDS
+
+    form_parser() { clear(); }
+
+    //清空已解析的字段
+    void clear();
+
+    //原地解析 key1=value1&key2=value2，键和值都会被就地解码
+    //同名字段先出现者优先；返回本次新增的字段数，字段数超出MAX_FIELDS时返回-1
+    int parse(char *data, size_t len);
+
+    //O(1)查找字段，找到返回true并通过value返回解码后的值
+    bool get(std::string_view key, std::string_view &value) const;
+    bool has(std::string_view key) const;
+
+    int size() const { return m_count; }
+
+    //原地进行百分号和加号解码，返回解码后的长度
+    //非法的%XX序列按原样保留
+    static size_t decode(char *data, size_t len);
+
+private:
+    struct field
+    {
+        std::string_view key;
+        std::string_view value;
+    };
+
+    static uint32_t hash(std::string_view key);
+    int find_slot(std::string_view key) const;
+
+    field m_fields[MAX_FIELDS];
+    uint8_t m_slots[HASH_SIZE];     //存放字段下标+1，0表示空槽
+    int m_count;
+};
+
+#endif
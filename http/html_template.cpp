@@ -0,0 +1,290 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "html_template.h"
+#include "../log/log.h"
+
+//需要转义的字符对应的实体，其余为NULL
+static const char *escape_entity(unsigned char c, size_t &len)
+{
+    switch (c)
+    {
+    case '&':
+        len = 5;
+        return "&amp;";
+    case '<':
+        len = 4;
+        return "&lt;";
+    case '>':
+        len = 4;
+        return "&gt;";
+    case '"':
+        len = 6;
+        return "&quot;";
+    case '\'':
+        len = 5;
+        return "&#39;";
+    default:
+        return NULL;
+    }
+}
+
+//SWAR：把8个字节当作一个64位整数，同时判断其中是否有字节等于c
+//(x - 0x01..01) & ~x & 0x80..80 非0当且仅当x中有0字节
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+static inline uint64_t has_byte(uint64_t w, unsigned char c)
+{
+    uint64_t x = w ^ (ONES * c);
+    return (x - ONES) & ~x & HIGHS;
+}
+
+static inline bool needs_escape(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return (has_byte(w, '&') | has_byte(w, '<') | has_byte(w, '>') | has_byte(w, '"') | has_byte(w, '\'')) != 0;
+}
+
+size_t html_escaped_length(string_view s)
+{
+    const char *p = s.data();
+    size_t n = s.size();
+    size_t len = n;
+    size_t i = 0;
+    while (i < n)
+    {
+        if (i + 8 <= n && !needs_escape(p + i))
+        {
+            i += 8;
+            continue;
+        }
+        //这一组(或末尾不足8字节)逐字节处理
+        size_t end = i + 8 <= n ? i + 8 : n;
+        for (; i < end; ++i)
+        {
+            size_t entity_len;
+            if (escape_entity(p[i], entity_len))
+                len += entity_len - 1;
+        }
+    }
+    return len;
+}
+
+char *html_escape(char *out, string_view s)
+{
+    const char *p = s.data();
+    size_t n = s.size();
+    size_t i = 0;
+    size_t run = 0;     //尚未拷贝的不需转义的一段的起点
+    while (i < n)
+    {
+        if (i + 8 <= n && !needs_escape(p + i))
+        {
+            i += 8;
+            continue;
+        }
+        size_t end = i + 8 <= n ? i + 8 : n;
+        for (; i < end; ++i)
+        {
+            size_t entity_len;
+            const char *entity = escape_entity(p[i], entity_len);
+            if (!entity)
+                continue;
+            memcpy(out, p + run, i - run);
+            out += i - run;
+            memcpy(out, entity, entity_len);
+            out += entity_len;
+            run = i + 1;
+        }
+    }
+    memcpy(out, p + run, n - run);
+    return out + n - run;
+}
+
+static bool valid_slot_name(string_view name)
+{
+    if (name.empty())
+        return false;
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        char c = name[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+bool html_template::compile(string path, string text)
+{
+    m_path = std::move(path);
+    m_text = std::move(text);
+    m_parts.clear();
+    m_slots.clear();
+    m_static_len = 0;
+
+    size_t pos = 0;
+    while (pos < m_text.size())
+    {
+        size_t open = m_text.find("{{", pos);
+        size_t static_end = open == string::npos ? m_text.size() : open;
+        if (static_end > pos)
+        {
+            part p = {pos, static_end - pos, -1, false};
+            m_parts.push_back(p);
+            m_static_len += p.len;
+        }
+        if (open == string::npos)
+            break;
+
+        bool raw = m_text.compare(open, 3, "{{{") == 0;
+        size_t name_start = open + (raw ? 3 : 2);
+        size_t close = m_text.find(raw ? "}}}" : "}}", name_start);
+        if (close == string::npos)
+            return false;
+        string_view name(m_text.data() + name_start, close - name_start);
+        while (!name.empty() && name.front() == ' ')
+            name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ')
+            name.remove_suffix(1);
+        if (!valid_slot_name(name))
+            return false;
+        int index = slot(name);
+        if (index < 0)
+        {
+            if (m_slots.size() == MAX_SLOTS)
+                return false;
+            index = m_slots.size();
+            m_slots.push_back(string(name));
+        }
+        part p = {0, 0, index, raw};
+        m_parts.push_back(p);
+        pos = close + (raw ? 3 : 2);
+    }
+    return true;
+}
+
+int html_template::slot(string_view name) const
+{
+    for (size_t i = 0; i < m_slots.size(); ++i)
+    {
+        if (m_slots[i] == name)
+            return i;
+    }
+    return -1;
+}
+
+size_t html_template::length(const string_view *values) const
+{
+    size_t len = m_static_len;
+    for (size_t i = 0; i < m_parts.size(); ++i)
+    {
+        const part &p = m_parts[i];
+        if (p.slot < 0)
+            continue;
+        const string_view &v = values[p.slot];
+        len += p.raw ? v.size() : html_escaped_length(v);
+    }
+    return len;
+}
+
+bool html_template::render(const string_view *values, response_segments &out) const
+{
+    //所有槽的值转义后写入同一块内存，由out中引用它的第一段负责释放
+    size_t dynamic_len = length(values) - m_static_len;
+    char *buf = NULL;
+    if (dynamic_len)
+    {
+        buf = (char *)malloc(dynamic_len);
+        if (!buf)
+            return false;
+    }
+    char *p = buf;
+    bool owned = false;
+    for (size_t i = 0; i < m_parts.size(); ++i)
+    {
+        const part &pt = m_parts[i];
+        if (pt.slot < 0)
+        {
+            out.add(m_text.data() + pt.offset, pt.len);
+            continue;
+        }
+        const string_view &v = values[pt.slot];
+        char *start = p;
+        if (pt.raw)
+        {
+            memcpy(p, v.data(), v.size());
+            p += v.size();
+        }
+        else
+            p = html_escape(p, v);
+        if (p == start)
+            continue;
+        if (!owned)
+        {
+            out.add_owned(start, p - start);
+            owned = true;
+        }
+        else
+            out.add(start, p - start);
+    }
+    return true;
+}
+
+template_registry::~template_registry()
+{
+    for (unordered_map<string_view, html_template *>::iterator it = m_templates.begin(); it != m_templates.end(); ++it)
+        delete it->second;
+}
+
+//读取整个文件，失败返回false
+static bool read_file(const string &path, string &out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    out.clear();
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        out.append(buf, n);
+    close(fd);
+    return n == 0;
+}
+
+int template_registry::init(const char *doc_root, const char *const *pages, int count, int close_log)
+{
+    m_close_log = close_log;
+    int compiled = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        string text;
+        if (!read_file(string(doc_root) + pages[i], text))
+        {
+            LOG_ERROR("read template %s failed, errno is:%d", pages[i], errno);
+            continue;
+        }
+        html_template *t = new html_template;
+        if (!t->compile(pages[i], std::move(text)))
+        {
+            LOG_ERROR("compile template %s failed", pages[i]);
+            delete t;
+            continue;
+        }
+        m_templates[t->path()] = t;
+        ++compiled;
+    }
+    LOG_INFO("compiled %d html templates", compiled);
+    return compiled;
+}
+
+const html_template *template_registry::find(string_view path) const
+{
+    unordered_map<string_view, html_template *>::const_iterator it = m_templates.find(path);
+    return it == m_templates.end() ? NULL : it->second;
+}
@@ -0,0 +1,88 @@
+#ifndef HTML_TEMPLATE_H
+#define HTML_TEMPLATE_H
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include "response_segments.h"
+
+using namespace std;
+
+// HTML模板
+// 明确登记的页面在启动时编译为静态片段和槽，{{name}}的值按HTML转义，{{{name}}}原样输出
+// 其余页面即使含有{{name}}(如前端框架的模板语法)也按普通静态文件发送
+// 渲染时静态片段直接引用模板文本，只有槽的值需要转义并写入一块新内存，整个页面作为若干段交给writev发出
+// 模板在启动时编译一次，之后修改文件需要重启才生效
+
+//转义后的长度与转义，按8字节一组检查是否含有需要转义的字符，不含时整组跳过
+size_t html_escaped_length(string_view s);
+char *html_escape(char *out, string_view s);
+
+//按名称绑定到槽的值
+struct template_value
+{
+    string_view name;
+    string_view value;
+};
+
+class html_template
+{
+public:
+    static const int MAX_SLOTS = 8;     //一个模板最多的不同槽数
+
+    //编译失败(槽未闭合、槽名非法或槽过多)时返回false
+    bool compile(string path, string text);
+    const string &path() const { return m_path; }
+
+    //槽名对应的下标，没有该槽返回-1；values按下标给出各槽的值
+    int slot(string_view name) const;
+    int slot_count() const { return (int)m_slots.size(); }
+
+    //渲染后的字节数
+    size_t length(const string_view *values) const;
+    //将静态片段与转义后的值依次加入out，内存不足返回false
+    bool render(const string_view *values, response_segments &out) const;
+
+private:
+    struct part
+    {
+        size_t offset;      //静态片段在m_text中的位置
+        size_t len;
+        int slot;           //槽的下标，静态片段为-1
+        bool raw;           //{{{name}}}，不转义
+    };
+
+    string m_path;
+    string m_text;
+    vector<part> m_parts;
+    vector<string> m_slots;
+    size_t m_static_len;
+};
+
+//网站目录下的模板，单例
+class template_registry
+{
+public:
+    static template_registry *get_instance()
+    {
+        static template_registry instance;
+        return &instance;
+    }
+
+    //编译doc_root下登记的页面，pages为相对网站根目录的路径，返回编译成功的模板数
+    int init(const char *doc_root, const char *const *pages, int count, int close_log);
+
+    //path为相对网站根目录的路径，如/welcome.html，不是模板时返回NULL
+    const html_template *find(string_view path) const;
+
+private:
+    template_registry() : m_close_log(0) {}
+    ~template_registry();
+
+    unordered_map<string_view, html_template *> m_templates;   //键指向模板自身的path
+    int m_close_log;
+};
+
+#endif
@@ -1,17 +1,17 @@
 #include "http_conn.h"
 #include <mysql/mysql.h>
 #include <fstream>
+#include <time.h>
+#include <charconv>
+#include <linux/errqueue.h>
 
-//定义http响应的一些状态信息
-const char *ok_200_title = "OK";
-const char *error_400_title = "Bad Request";
+//定义http响应的错误页面内容
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
-const char *error_403_title = "Forbidden";
 const char *error_403_form = "You do not have permission to get file form this server.\n";
-const char *error_404_title = "Not Found";
 const char *error_404_form = "The requested file was not found on this server.\n";
-const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
+const char *error_431_form = "The request header fields are too large.\n";
+const char *error_413_form = "The request body is larger than the server is willing to accept.\n";
 
 locker m_lock;
 map<string, string> users;
@@ -100,6 +100,13 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode)
 //  --------------成员函数---------------------
 int http_conn::m_user_count = 0;
 int http_conn::m_epollfd = -1;
+long http_conn::m_upload_threshold = 1024;
+bool http_conn::m_sendfile = false;
+long http_conn::m_prerender_size = 16384;
+size_t http_conn::m_zerocopy_threshold = 0;
+const char *http_conn::m_upload_dir = "/tmp";
+const char *const http_conn::template_pages[TEMPLATE_PAGE_COUNT] = {"/welcome.html", "/logError.html", "/registerError.html"};
+conn_limits http_conn::m_limits = {10, 1024, 15, 30, 64, http_conn::READ_BUFFER_SIZE - 1, 8L << 20};
 
 //初始化连接,外部调用初始化套接字地址
 void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
@@ -107,6 +114,16 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 {
     m_sockfd = sockfd;
     m_address = addr;
+    //内核不支持时setsockopt失败，这个连接照常拷贝发送
+    int on = 1;
+    m_zerocopy = m_zerocopy_threshold > 0 &&
+                 setsockopt(sockfd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+    //超时、对端关闭等由定时器回调关闭的连接没有经过close_conn，上一个连接还持有的条目在这里释放
+    //旧套接字已经关闭，不会再有完成通知，内核持有页的引用，释放不影响还在发送的数据
+    release_zerocopy(m_zc_seq);
+    m_zc_seq = 0;
+    m_zc_head = 0;
+    m_zc_count = 0;
 
     addfd(m_epollfd, sockfd, true, m_TRIGMode);
     //当浏览器出现连接重置时，可能是网站根目录出错或http响应格式出错或者访问的文件中内容完全为空
@@ -124,6 +141,12 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
 void http_conn::close_conn(bool real_close){
     if(real_close && (m_sockfd != -1)){
         printf("close %d\n", m_sockfd);
+        close_body();
+        unmap();
+        ++m_io_ticket;
+        //关闭后再也收不到通知；还在发送的是文件的页缓存，内核持有页的引用，释放映射不影响发送
+        reap_zerocopy();
+        release_zerocopy(m_zc_seq);
         removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
@@ -133,30 +156,72 @@ void http_conn::close_conn(bool real_close){
 //初始化新接受的连接
 //check_state默认为分析请求行状态
 void http_conn::init(){
-    mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
+    m_window_file = 0;
+    m_ready_end = 0;
+    m_io_wait = false;
+    m_io_done = false;
+    m_inline = false;
+    m_deferred = false;
+    m_template = NULL;
+    ++m_io_ticket;
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
     m_method = GET;
     m_url = 0;
+    m_query = 0;
     m_version = 0;
     m_content_length = 0;
     m_host = 0;
+    m_content_type = 0;
+    m_string = 0;
+    m_expect_continue = false;
+    m_accept_encoding = 0;
+    m_if_none_match = 0;
+    m_if_modified_since = 0;
+    m_range = 0;
+    m_if_range = 0;
+    m_range_count = 0;
+    m_cache_control = std::string_view();
+    m_content_encoding = 0;
+    m_vary = false;
+    m_body_received = 0;
+    close_body();
+    unmap();
     m_start_line = 0;
     m_checked_idx = 0;
     m_read_idx = 0;
-    m_write_idx = 0;
-    cgi = 0;
+    m_header_count = 0;
+    m_idle_start = coarse_clock::get_instance()->now_ms();
+    m_request_start = m_body_start = m_send_progress = m_idle_start;
+    m_response.clear();
     m_state = 0;
     timer_flag = 0;
     improv = 0;
 
     memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
     memset(m_real_file, '\0', FILENAME_LEN);
 }
 
+//应答未发送完时看发送有没有进展，否则按请求读到哪一步决定期限
+//只在主线程处理完读写事件后调用，此时没有工作线程在修改连接的状态
+long long http_conn::deadline(long long now) const
+{
+    if (bytes_to_send > 0 || m_io_wait)
+        return m_send_progress + m_limits.write_timeout * 1000LL;
+    if (m_check_state == CHECK_STATE_CONTENT)
+    {
+        if (m_limits.body_rate <= 0)
+            return now + m_limits.idle_timeout * 1000LL;
+        long long received = m_body_fd != -1 ? m_body_received : m_read_idx - m_checked_idx;
+        return m_body_start + m_limits.header_timeout * 1000LL + received * 1000 / m_limits.body_rate;
+    }
+    if (m_read_idx > 0)
+        return m_request_start + m_limits.header_timeout * 1000LL;
+    return m_idle_start + m_limits.idle_timeout * 1000LL;
+}
+
 //从状态机，用于分析出一行内容,判断依据\r\n
 //返回值为行的读取状态，有LINE_OK,LINE_BAD,LINE_OPEN
 http_conn::LINE_STATUS http_conn::parse_line()
@@ -206,10 +271,17 @@ http_conn::LINE_STATUS http_conn::parse_line()
 //非阻塞ET工作模式下，需要一次性将数据读完
 bool http_conn::read_once()
 {
+    //请求体正在转存到临时文件，直接从socket搬运到文件
+    if (m_body_fd != -1 && m_check_state == CHECK_STATE_CONTENT)
+        return read_body();
+
     if(m_read_idx > READ_BUFFER_SIZE){
         return false;
     }
     int bytes_read = 0;
+    //新请求的第一个字节，请求头的期限从这里开始计算
+    if (m_read_idx == 0 && m_check_state == CHECK_STATE_REQUESTLINE)
+        m_request_start = coarse_clock::get_instance()->now_ms();
 
     //LT读取数据
     if(0 == m_TRIGMode){
@@ -243,6 +315,92 @@ bool http_conn::read_once()
     
 }
 
+//创建存放请求体的临时文件，以及splice用的管道
+bool http_conn::open_body()
+{
+    m_body_fd = open(m_upload_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (m_body_fd == -1)
+    {
+        //文件系统不支持O_TMPFILE时退化为mkstemp后立即unlink
+        char path[FILENAME_LEN];
+        snprintf(path, sizeof(path), "%s/upload.XXXXXX", m_upload_dir);
+        m_body_fd = mkstemp(path);
+        if (m_body_fd == -1)
+        {
+            LOG_ERROR("create upload file in %s failed, errno is:%d", m_upload_dir, errno);
+            return false;
+        }
+        unlink(path);
+    }
+    if (pipe2(m_body_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        m_body_pipe[0] = m_body_pipe[1] = -1;
+    return true;
+}
+
+//从socket读取请求体并写入临时文件，数据经由管道splice，不经过用户态缓冲区
+//管道不可用时退化为借用读缓冲区中转
+bool http_conn::read_body()
+{
+    while (m_body_received < m_content_length)
+    {
+        long want = m_content_length - m_body_received;
+        ssize_t n;
+        if (m_body_pipe[0] != -1)
+        {
+            if (want > 65536)
+                want = 65536;
+            n = splice(m_sockfd, NULL, m_body_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        }
+        else
+        {
+            if (want > READ_BUFFER_SIZE - m_read_idx)
+                want = READ_BUFFER_SIZE - m_read_idx;
+            n = recv(m_sockfd, m_read_buf + m_read_idx, want, 0);
+        }
+        if (n == 0)
+            return false;
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+
+        //把本次收到的数据完整落盘
+        ssize_t left = n;
+        while (left > 0)
+        {
+            ssize_t w;
+            if (m_body_pipe[0] != -1)
+                w = splice(m_body_pipe[0], NULL, m_body_fd, NULL, left, SPLICE_F_MOVE);
+            else
+                w = ::write(m_body_fd, m_read_buf + m_read_idx + (n - left), left);
+            if (w <= 0)
+                return false;
+            left -= w;
+        }
+        m_body_received += n;
+    }
+    return true;
+}
+
+void http_conn::close_body_pipe()
+{
+    if (m_body_pipe[0] != -1)
+    {
+        close(m_body_pipe[0]);
+        close(m_body_pipe[1]);
+        m_body_pipe[0] = m_body_pipe[1] = -1;
+    }
+}
+
+//关闭请求体临时文件，文件已unlink，关闭后即被回收
+void http_conn::close_body()
+{
+    close_body_pipe();
+    if (m_body_fd != -1)
+    {
+        close(m_body_fd);
+        m_body_fd = -1;
+    }
+}
+
 //解析http请求行，获得请求方法，目标url及http版本号
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
 {
@@ -263,10 +421,7 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     if (strcasecmp(method, "GET") == 0)
         m_method = GET;
     else if (strcasecmp(method, "POST") == 0)
-    {
         m_method = POST;
-        cgi = 1;
-    }
     else
         return BAD_REQUEST;
     
@@ -305,9 +460,10 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text)
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
 
-    //当url为/时，显示欢迎界面
-    if (strlen(m_url) == 1)
-        strcat(m_url, "judge.html");
+    //分离查询串，字段留到do_request中按需解析
+    m_query = strchr(m_url, '?');
+    if (m_query)
+        *m_query++ = '\0';
 
     //主状态机状态转移
     m_check_state = CHECK_STATE_HEADER;
@@ -326,11 +482,39 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
         {
             //post请求需要改变主状态机的状态
             m_check_state = CHECK_STATE_CONTENT;
+            m_body_start = coarse_clock::get_instance()->now_ms();
+            if (m_content_length > m_limits.max_body_size)
+                return BODY_TOO_LARGE;
+            bool fits = m_checked_idx + m_content_length < READ_BUFFER_SIZE;
+            //登录注册等接口在读缓冲区中原地解析请求体，放不下的直接拒绝，不转存
+            const route<route_handler> *r = find_route();
+            if (r && r->handler != &http_conn::serve_page)
+            {
+                if (!fits)
+                    return BODY_TOO_LARGE;
+            }
+            //其余请求体超过阈值或读缓冲区放不下时，转存到临时文件
+            else if (m_content_length > m_upload_threshold || !fits)
+            {
+                if (!open_body())
+                    return INTERNAL_ERROR;
+            }
+            //客户端在等待100 Continue，且请求体还没有开始发送，立即应答避免其超时等待
+            if (m_expect_continue && m_read_idx == m_checked_idx)
+            {
+                static const char continue_line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+                send(m_sockfd, continue_line, sizeof(continue_line) - 1, 0);
+            }
             return NO_REQUEST;
         }
         // 否则说明我们已经得到了一个完整的HTTP请求
         return GET_REQUEST;
     }
+    //请求头行数超出限制
+    else if (++m_header_count > m_limits.max_headers)
+    {
+        return HEADER_TOO_LARGE;
+    }
     //解析头部连接字段
     else if (strncasecmp(text, "Connection:", 11) == 0)
     {
@@ -350,7 +534,62 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
     {
         text += 15;
         text += strspn(text, " \t");
-        m_content_length = atol(text);
+        //只接受十进制数字，负数、非数字或溢出时无法确定请求体的边界
+        if (*text < '0' || *text > '9')
+            return MALFORMED_REQUEST;
+        char *end;
+        errno = 0;
+        m_content_length = strtol(text, &end, 10);
+        end += strspn(end, " \t");
+        if (errno == ERANGE || *end != '\0')
+            return MALFORMED_REQUEST;
+    }
+    //解析客户端可接受的内容编码，Accept-Encoding: gzip, deflate, br
+    else if (strncasecmp(text, "Accept-Encoding:", 16) == 0)
+    {
+        text += 16;
+        m_accept_encoding = parse_accept_encoding(text);
+    }
+    //条件请求的校验器
+    else if (strncasecmp(text, "If-None-Match:", 14) == 0)
+    {
+        text += 14;
+        text += strspn(text, " \t");
+        m_if_none_match = text;
+    }
+    else if (strncasecmp(text, "If-Modified-Since:", 18) == 0)
+    {
+        text += 18;
+        text += strspn(text, " \t");
+        m_if_modified_since = text;
+    }
+    //字节范围请求
+    else if (strncasecmp(text, "Range:", 6) == 0)
+    {
+        text += 6;
+        text += strspn(text, " \t");
+        m_range = text;
+    }
+    else if (strncasecmp(text, "If-Range:", 9) == 0)
+    {
+        text += 9;
+        text += strspn(text, " \t");
+        m_if_range = text;
+    }
+    //解析Expect字段，Expect: 100-continue
+    else if (strncasecmp(text, "Expect:", 7) == 0)
+    {
+        text += 7;
+        text += strspn(text, " \t");
+        if (strcasecmp(text, "100-continue") == 0)
+            m_expect_continue = true;
+    }
+    //解析请求体类型
+    else if (strncasecmp(text, "Content-Type:", 13) == 0)
+    {
+        text += 13;
+        text += strspn(text, " \t");
+        m_content_type = text;
     }
     //解析请求头部host字段
     else if (strncasecmp(text, "Host:", 5) == 0)
@@ -366,9 +605,73 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text)
     return NO_REQUEST;
 }
 
+//解析Accept-Encoding，返回可接受编码的位掩码，q=0的编码视为不接受
+unsigned http_conn::parse_accept_encoding(const char *text)
+{
+    static const char *names[ENCODING_COUNT] = {"gzip", "br"};
+    unsigned accepted = 0;
+    unsigned refused = 0;
+    while (*text)
+    {
+        text += strspn(text, " \t,");
+        size_t len = strcspn(text, ",");
+        size_t name_len = strcspn(text, ";, \t");
+        if (name_len > len)
+            name_len = len;
+
+        //q参数为0表示明确拒绝
+        bool zero_q = false;
+        const char *q = (const char *)memchr(text, ';', len);
+        if (q)
+        {
+            q += 1 + strspn(q + 1, " \t");
+            if (strncasecmp(q, "q=", 2) == 0 && atof(q + 2) <= 0)
+                zero_q = true;
+        }
+
+        unsigned bits = 0;
+        if (name_len == 1 && text[0] == '*')
+            bits = (1u << ENCODING_COUNT) - 1;
+        for (int i = 0; i < ENCODING_COUNT; ++i)
+        {
+            if (strlen(names[i]) == name_len && strncasecmp(text, names[i], name_len) == 0)
+                bits = 1u << i;
+        }
+        if (zero_q)
+            refused |= bits;
+        else
+            accepted |= bits;
+        text += len;
+    }
+    return accepted & ~refused;
+}
+
 //判断http请求是否被完整读入
 http_conn::HTTP_CODE http_conn::parse_content(char *text)
 {
+    //请求体转存到临时文件时，先把读缓冲区中已收到的部分写入文件
+    if (m_body_fd != -1)
+    {
+        long buffered = m_read_idx - m_checked_idx;
+        if (buffered > m_content_length - m_body_received)
+            buffered = m_content_length - m_body_received;
+        while (buffered > 0)
+        {
+            ssize_t n = ::write(m_body_fd, text, buffered);
+            if (n <= 0)
+                return INTERNAL_ERROR;
+            text += n;
+            buffered -= n;
+            m_body_received += n;
+        }
+        m_read_idx = m_checked_idx;
+        m_read_buf[m_read_idx] = '\0';
+        if (m_body_received < m_content_length)
+            return NO_REQUEST;
+        lseek(m_body_fd, 0, SEEK_SET);
+        close_body_pipe();
+        return GET_REQUEST;
+    }
     //判断是否读取了消息体
     if (m_read_idx >= (m_content_length + m_checked_idx))
     {
@@ -415,19 +718,25 @@ http_conn::HTTP_CODE http_conn::process_read()
         {
             //解析请求头
             ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            if (ret == BAD_REQUEST || ret == INTERNAL_ERROR || ret == HEADER_TOO_LARGE ||
+                ret == MALFORMED_REQUEST || ret == BODY_TOO_LARGE)
+                return ret;
             //对于get请求 则需要跳转到报文响应函数
             else if (ret == GET_REQUEST)
             {
                 return do_request();
             }
+            //带请求体的请求交给线程池，从CHECK_STATE_CONTENT继续解析
+            if (m_inline && m_check_state == CHECK_STATE_CONTENT)
+                return DEFER_REQUEST;
             break;
         }
         case CHECK_STATE_CONTENT:
         {
             //解析消息体
             ret = parse_content(text);
+            if (ret == INTERNAL_ERROR)
+                return INTERNAL_ERROR;
             //对于post请求 则需要跳转到报文响应函数
             if (ret == GET_REQUEST)
             {
@@ -441,171 +750,717 @@ http_conn::HTTP_CODE http_conn::process_read()
             return INTERNAL_ERROR;
         }
     }
+    //请求行和头部还没有收完，已收到的部分超出限制
+    if (m_check_state != CHECK_STATE_CONTENT && m_read_idx >= m_limits.max_header_size)
+        return HEADER_TOO_LARGE;
     return NO_REQUEST;
 }
 
-// 当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性，
-// 如果目标文件存在、对所有用户可读，且不是目录，则使用mmap将其
-// 映射到内存地址m_file_address处，并告诉调用者获取文件成功
+//按请求方法和路径查找路由，未命中返回NULL
+const route<http_conn::route_handler> *http_conn::find_route() const
+{
+    //路由表，新增接口只需在这里登记路径、方法和处理函数
+    static constexpr route<route_handler> route_list[] = {
+        {ROUTE_ANY, MATCH_EXACT, "/", &http_conn::serve_page, "/judge.html"},
+        {ROUTE_ANY, MATCH_EXACT, "/0", &http_conn::serve_page, "/register.html"},     //注册界面
+        {ROUTE_ANY, MATCH_EXACT, "/1", &http_conn::serve_page, "/log.html"},          //登录界面
+        {ROUTE_POST, MATCH_EXACT, "/2CGISQL.cgi", &http_conn::do_login, NULL},        //登录检测
+        {ROUTE_POST, MATCH_EXACT, "/3CGISQL.cgi", &http_conn::do_register, NULL},     //注册检测
+        {ROUTE_ANY, MATCH_EXACT, "/5", &http_conn::serve_page, "/picture.html"},      //图片界面
+        {ROUTE_ANY, MATCH_EXACT, "/6", &http_conn::serve_page, "/video.html"},        //视频界面
+        {ROUTE_ANY, MATCH_EXACT, "/7", &http_conn::serve_page, "/fans.html"},         //关注界面
+        {ROUTE_POST, MATCH_EXACT, "/api/login", &http_conn::api_login, NULL},         //JSON登录
+        {ROUTE_POST, MATCH_EXACT, "/api/register", &http_conn::api_register, NULL},   //JSON注册
+    };
+    static constexpr auto routes = make_route_table(route_list);
+    static_assert(routes.perfect(), "duplicate exact route");
+
+    return routes.match(m_method, m_url);
+}
+
+// 当得到一个完整、正确的HTTP请求时，按路由表分发给对应的处理函数
+// 未命中任何路由的请求按静态文件处理
 http_conn::HTTP_CODE http_conn::do_request()
 {
-    /*  /home/cyn/webserver/resources   */  
-    //将初始化的m_real_file赋值为网站根目录
-    strcpy(m_real_file,doc_root);
-    int len = strlen(doc_root);
+    const route<route_handler> *r = find_route();
+    if (!r)
+        return serve_page(m_url);
+    //登录注册等接口需要数据库，只有静态页面可以在主线程上处理
+    if (m_inline && r->handler != &http_conn::serve_page)
+    {
+        m_deferred = true;
+        return DEFER_REQUEST;
+    }
+    return (this->*(r->handler))(r->target);
+}
 
-    //找到m_url中/的位置, 在参数 str 所指向的字符串中搜索最后一次出现字符 c（一个无符号字符）的位置(从后往前)
-    const char *p = strrchr(m_url, '/');
-    
-    //处理cgi
-    //实现登录和注册校验
-    if (cgi == 1 && (*(p + 1) == '2' || *(p + 1) == '3'))
-    {
-
-        //根据标志判断是登录检测还是注册检测
-        char flag = m_url[1];
-
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcat(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        //将用户名和密码提取出来
-        //user=123&passwd=123
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i - 5] = m_string[i];
-        name[i - 5] = '\0';
-
-        int j = 0;
-        for (i = i + 10; m_string[i] != '\0'; ++i, ++j)
-            password[j] = m_string[i];
-        password[j] = '\0';
-
-        if (*(p + 1) == '3')
+//用户名和密码是否与user表中的记录一致
+bool http_conn::check_user(const string &name, const string &password)
+{
+    m_lock.lock();
+    map<string, string>::iterator it = users.find(name);
+    bool ok = it != users.end() && it->second == password;
+    m_lock.unlock();
+    return ok;
+}
+
+//用户名和密码解码后不能含有NUL等控制字符
+bool http_conn::valid_credential(std::string_view s)
+{
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        unsigned char c = s[i];
+        if (c < 0x20 || c == 0x7f)
+            return false;
+    }
+    return true;
+}
+
+//按连接的字符集转义后放在单引号中
+static void append_sql_string(string &sql, MYSQL *mysql, const string &value)
+{
+    size_t len = sql.size();
+    sql.resize(len + value.size() * 2 + 3);
+    sql[len] = '\'';
+    len += 1 + mysql_real_escape_string(mysql, &sql[len + 1], value.data(), value.size());
+    sql[len++] = '\'';
+    sql.resize(len);
+}
+
+//注册新用户，先检测是否有重名的，没有重名的再插入数据库
+//只有这里需要数据库连接，在这里才从连接池取，其余请求不占用连接
+http_conn::REGISTER_RESULT http_conn::register_user(const string &name, const string &password)
+{
+    m_lock.lock();
+    if (users.find(name) != users.end())
+    {
+        m_lock.unlock();
+        return REGISTER_EXISTS;
+    }
+    MYSQL *mysql = NULL;
+    connectionRAII mysqlcon(&mysql, connection_pool::GetInstance());
+    int res = 1;
+    if (mysql)
+    {
+        //用户名和密码来自解码后的表单或JSON，可能含有引号，必须转义
+        string sql_insert = "INSERT INTO user(username, passwd) VALUES(";
+        append_sql_string(sql_insert, mysql, name);
+        sql_insert += ", ";
+        append_sql_string(sql_insert, mysql, password);
+        sql_insert += ")";
+        res = mysql_query(mysql, sql_insert.c_str());
+    }
+    if (!res)
+        users.insert(pair<string, string>(name, password));
+    m_lock.unlock();
+    return res ? REGISTER_FAILED : REGISTER_OK;
+}
+
+//登录检测，若浏览器端输入的用户名和密码在表中可以查找到则跳转欢迎页
+http_conn::HTTP_CODE http_conn::do_login(const char *)
+{
+    //user=123&password=123
+    std::string_view name, password;
+    if (!parse_form())
+        return MALFORMED_REQUEST;
+    m_form.get("user", name);
+    m_form.get("password", password);
+    if (!valid_credential(name) || !valid_credential(password))
+        return MALFORMED_REQUEST;
+
+    template_value values[] = {{"user", name}};
+    if (check_user(string(name), string(password)))
+        return render_page("/welcome.html", values, 1);
+    return render_page("/logError.html", values, 1);
+}
+
+//注册检测，注册成功跳转登录页
+http_conn::HTTP_CODE http_conn::do_register(const char *)
+{
+    std::string_view name, password;
+    if (!parse_form())
+        return MALFORMED_REQUEST;
+    m_form.get("user", name);
+    m_form.get("password", password);
+    if (!valid_credential(name) || !valid_credential(password))
+        return MALFORMED_REQUEST;
+
+    if (REGISTER_OK == register_user(string(name), string(password)))
+        return serve_page("/log.html");
+    template_value values[] = {{"user", name}};
+    return render_page("/registerError.html", values, 1);
+}
+
+//解析JSON请求体中的user和password字段，失败时已生成400应答
+bool http_conn::parse_credentials(std::string_view &name, std::string_view &password)
+{
+    if (!m_string || !m_json.parse(m_string, m_content_length) ||
+        !m_json.get_string("user", name) || !m_json.get_string("password", password) ||
+        name.empty())
+    {
+        json_reply(400, false, "expected {\"user\":string,\"password\":string}");
+        return false;
+    }
+    if (!valid_credential(name) || !valid_credential(password))
+    {
+        json_reply(400, false, "user and password must not contain control characters");
+        return false;
+    }
+    return true;
+}
+
+//POST /api/login  {"user":"...","password":"..."}
+http_conn::HTTP_CODE http_conn::api_login(const char *)
+{
+    std::string_view name, password;
+    if (!parse_credentials(name, password))
+        return JSON_REQUEST;
+    if (check_user(string(name), string(password)))
+        json_reply(200, true, NULL, name);
+    else
+        json_reply(401, false, "invalid user or password");
+    return JSON_REQUEST;
+}
+
+//POST /api/register  {"user":"...","password":"..."}
+http_conn::HTTP_CODE http_conn::api_register(const char *)
+{
+    std::string_view name, password;
+    if (!parse_credentials(name, password))
+        return JSON_REQUEST;
+    switch (register_user(string(name), string(password)))
+    {
+    case REGISTER_OK:
+        json_reply(200, true, NULL, name);
+        break;
+    case REGISTER_EXISTS:
+        json_reply(409, false, "user already exists");
+        break;
+    default:
+        json_reply(500, false, "database error");
+        break;
+    }
+    return JSON_REQUEST;
+}
+
+//生成JSON应答体 {"ok":true,"user":"..."} 或 {"ok":false,"error":"..."}
+void http_conn::json_reply(int status, bool ok, const char *error, std::string_view name)
+{
+    json_writer writer(m_json_buf, JSON_BUFFER_SIZE);
+    writer.begin_object().key("ok").boolean(ok);
+    if (error)
+        writer.key("error").string(error);
+    if (!name.empty())
+        writer.key("user").string(name);
+    writer.end_object();
+
+    //用户名过长放不下时只返回结果
+    if (!writer.ok())
+    {
+        json_writer fallback(m_json_buf, JSON_BUFFER_SIZE);
+        fallback.begin_object().key("ok").boolean(ok).end_object();
+        writer = fallback;
+    }
+    m_json_status = status;
+    m_json_len = writer.size();
+}
+
+http_conn::HTTP_CODE http_conn::render_page(const char *path, const template_value *values, int count)
+{
+    m_template = template_registry::get_instance()->find(path);
+    if (!m_template)
+        return serve_page(path);
+    for (int i = 0; i < html_template::MAX_SLOTS; ++i)
+        m_template_values[i] = std::string_view();
+    //模板中没有的名称忽略
+    for (int i = 0; i < count; ++i)
+    {
+        int slot = m_template->slot(values[i].name);
+        if (slot >= 0)
+            m_template_values[slot] = values[i].value;
+    }
+    return TEMPLATE_REQUEST;
+}
+
+// 将网站根目录与path拼接为目标文件，如果目标文件存在、对所有用户可读，且不是目录，
+// 则从文件缓存中取得其内存映射m_file_address，并告诉调用者获取文件成功
+http_conn::HTTP_CODE http_conn::serve_page(const char *path)
+{
+    size_t root_len = strlen(doc_root);
+    size_t path_len = strlen(path);
+    if (root_len + path_len >= FILENAME_LEN)
+        return BAD_REQUEST;
+    //不允许通过..访问网站根目录之外的文件
+    if (strstr(path, "/.."))
+        return FORBIDDEN_REQUEST;
+    //模板页面只在内存中渲染，直接请求时各槽为空
+    if (template_registry::get_instance()->find(path))
+        return render_page(path, NULL, 0);
+
+    int err = 0;
+    //资源包中有的文件直接使用，不访问网站目录
+    m_file = file_cache::get_instance()->acquire_bundled(path);
+    if (!m_file)
+    {
+        memcpy(m_real_file, doc_root, root_len);
+        memcpy(m_real_file + root_len, path, path_len + 1);
+        //主线程上只查缓存，未命中需要访问文件系统，交给线程池
+        if (m_inline)
         {
-            //如果是注册，先检测数据库中是否有重名的
-            //没有重名的，进行增加数据
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end())
+            m_file = file_cache::get_instance()->lookup(m_real_file);
+            if (!m_file)
             {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else
-                    strcpy(m_url, "/registerError.html");
+                m_deferred = true;
+                return DEFER_REQUEST;
             }
-            else
-                strcpy(m_url, "/registerError.html");
         }
-        //如果是登录，直接判断
-        //若浏览器端输入的用户名和密码在表中可以查找到，返回1，否则返回0
-        else if (*(p + 1) == '2')
+        else
+            m_file = file_cache::get_instance()->acquire(m_real_file, err);
+    }
+    if (!m_file)
+    {
+        if (err == EACCES)
+            return FORBIDDEN_REQUEST;   //无读权限
+        if (err == EISDIR)
+            return BAD_REQUEST;         //请求的是目录
+        return NO_RESOURCE;             //文件不存在
+    }
+    //压缩版本首次获取时可能读盘或压缩，同样交给线程池
+    if (m_inline && !file_cache::get_instance()->variant_ready(m_file, m_accept_encoding))
+    {
+        unmap();
+        m_deferred = true;
+        return DEFER_REQUEST;
+    }
+    m_cache_control = cache_policy::get_instance()->lookup(path, mime_lookup(path));
+    //客户端支持压缩时改用压缩版本，编码按br、gzip的优先级选择
+    m_vary = m_file->compressible;
+    for (int i = ENCODING_COUNT - 1; i >= 0 && m_accept_encoding; --i)
+    {
+        if (!(m_accept_encoding & (1u << i)))
+            continue;
+        file_entry *variant = file_cache::get_instance()->acquire_variant(m_file, (CONTENT_ENCODING)i);
+        if (variant)
         {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else
-                strcpy(m_url, "/logError.html");
+            static const char *names[ENCODING_COUNT] = {"gzip", "br"};
+            file_cache::get_instance()->release(m_file);
+            m_file = variant;
+            m_content_encoding = names[i];
+            m_vary = true;
+            break;
         }
     }
+    m_file_address = m_file->addr;
+    m_file_stat = m_file->st;
+    if (not_modified())
+        return NOT_MODIFIED;
+    return check_range();
+}
 
-    //如果请求资源为/0，表示跳转注册界面
-    if (*(p + 1) == '0')
+//If-None-Match中的ETag列表是否包含etag，按弱比较忽略W/前缀
+static bool etag_match(const char *list, const char *etag)
+{
+    size_t len = strlen(etag);
+    while (*list)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/register.html");
-        //将网站目录和/register.html进行拼接，更新到m_real_file中
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        list += strspn(list, " \t,");
+        if (*list == '*')
+            return true;
+        if (strncmp(list, "W/", 2) == 0)
+            list += 2;
+        if (strncmp(list, etag, len) == 0 && (list[len] == '\0' || list[len] == ',' ||
+                                               list[len] == ' ' || list[len] == '\t'))
+            return true;
+        list += strcspn(list, ",");
+    }
+    return false;
+}
 
-        free(m_url_real);
+//条件请求只对GET和HEAD生效，同时带有两个校验器时以If-None-Match为准
+bool http_conn::not_modified() const
+{
+    if (m_method != GET && m_method != HEAD)
+        return false;
+    if (m_if_none_match)
+        return etag_match(m_if_none_match, m_file->etag);
+    if (m_if_modified_since)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *end = strptime(m_if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return end && *end == '\0' && m_file->st.st_mtime <= timegm(&tm);
     }
-    //如果请求资源为/1，表示跳转登录界面
-    else if (*(p + 1) == '1')
+    return false;
+}
+
+//读取十进制数，没有数字或溢出时返回false
+static bool read_offset(const char *&p, off_t &value)
+{
+    long long v;
+    std::from_chars_result r = std::from_chars(p, p + strspn(p, "0123456789"), v);
+    if (r.ec != std::errc())
+        return false;
+    p = r.ptr;
+    value = v;
+    return true;
+}
+
+//解析Range: bytes=first-last, first-, -suffix
+//返回可满足的范围数，0表示全部不可满足；格式错误或范围过多时返回-1，此时忽略Range
+static int parse_ranges(const char *text, off_t size, http_conn::byte_range *ranges, int max)
+{
+    if (strncasecmp(text, "bytes=", 6) != 0)
+        return -1;
+    const char *p = text + 6;
+    int count = 0;
+    while (true)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        p += strspn(p, " \t,");
+        if (*p == '\0')
+            break;
+        off_t first, last;
+        bool satisfiable;
+        if (*p == '-')
+        {
+            //后缀范围，请求最后suffix个字节
+            off_t suffix;
+            ++p;
+            if (!read_offset(p, suffix))
+                return -1;
+            satisfiable = suffix > 0 && size > 0;
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+        }
+        else
+        {
+            if (!read_offset(p, first) || *p++ != '-')
+                return -1;
+            last = size - 1;
+            if (*p >= '0' && *p <= '9')
+            {
+                if (!read_offset(p, last) || last < first)
+                    return -1;
+                if (last >= size)
+                    last = size - 1;
+            }
+            satisfiable = first < size;
+        }
+        p += strspn(p, " \t");
+        if (*p != '\0' && *p != ',')
+            return -1;
+        if (!satisfiable)
+            continue;
+        if (count == max)
+            return -1;
+        ranges[count].first = first;
+        ranges[count].last = last;
+        ++count;
+    }
+    return count;
+}
 
-        free(m_url_real);
+//Range只对GET生效；If-Range与当前版本的ETag或Last-Modified不一致时返回整个文件
+http_conn::HTTP_CODE http_conn::check_range()
+{
+    if (!m_range || m_method != GET)
+        return FILE_REQUEST;
+    if (m_if_range)
+    {
+        //ETag按强比较，弱校验器不匹配
+        const char *validator = m_if_range[0] == '"' ? m_file->etag : m_file->last_modified;
+        if (strcmp(m_if_range, validator) != 0)
+            return FILE_REQUEST;
     }
-    //请求资源为/5，表示跳转图片界面
-    else if (*(p + 1) == '5')
+    int count = parse_ranges(m_range, m_file_stat.st_size, m_ranges, MAX_RANGES);
+    //多范围应答的文件片段直接引用整体映射，分段发送的大文件只支持单个范围
+    if (count < 0 || (count > 1 && !m_file->addr))
+        return FILE_REQUEST;
+    if (count == 0)
+        return RANGE_NOT_SATISFIABLE;
+    m_range_count = count;
+    return PARTIAL_CONTENT;
+}
+
+//解析请求体和查询串中的表单字段，请求体中的同名字段优先；字段过多时返回false
+bool http_conn::parse_form()
+{
+    m_form.clear();
+    if (m_string && (!m_content_type ||
+                     strncasecmp(m_content_type, "application/x-www-form-urlencoded", 33) == 0))
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        if (m_form.parse(m_string, m_content_length) < 0)
+            return false;
+    }
+    if (m_query && m_form.parse(m_query, strlen(m_query)) < 0)
+        return false;
+    return true;
+}
 
-        free(m_url_real);
+// 释放对缓存文件的引用及应答各段持有的资源
+void http_conn::unmap()
+{
+    if (m_window)
+    {
+        munmap(m_window, m_window_len);
+        m_window = 0;
     }
-    //请求资源为/6，表示跳转视频界面
-    else if (*(p + 1) == '6')
+    m_window_file = 0;
+    m_segments.clear();
+    if(m_file)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        file_cache::get_instance()->release(m_file);
+        m_file = 0;
+        m_file_address = 0;
+    }
+}
 
-        free(m_url_real);
+//发送文件段开头的内容，每次最多一个窗口
+//sendfile模式由内核直接从页缓存发送；否则每次只映射WINDOW_SIZE大小的一段，发完再映射下一段
+//因此无论文件多大，每个连接占用的地址空间都有上限
+ssize_t http_conn::send_file(const response_segments::segment &s, int flags)
+{
+    size_t count = min(s.len, file_cache::WINDOW_SIZE);
+    if (m_sendfile)
+    {
+        //资源包中的文件从base开始
+        off_t offset = s.entry->base + s.offset;
+        return sendfile(m_sockfd, s.entry->fd, &offset, count);
+    }
+
+    if (!map_window(s.entry, s.offset))
+        return -1;
+    size_t off = s.offset - m_window_start;
+    return send(m_sockfd, m_window + off, min(count, m_window_len - off), flags);
+}
+
+//确保entry中offset所在的窗口已映射，窗口按WINDOW_SIZE对齐
+bool http_conn::map_window(file_entry *entry, off_t offset)
+{
+    if (m_window && m_window_file == entry && offset >= m_window_start &&
+        offset < m_window_start + (off_t)m_window_len)
+        return true;
+    if (m_window)
+    {
+        munmap(m_window, m_window_len);
+        m_window = 0;
     }
-    //请求资源为/7，表示跳转粉丝界面
-    else if (*(p + 1) == '7')
+    if (m_window_file != entry)
     {
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file + len, m_url_real, strlen(m_url_real));
+        m_window_file = entry;
+        m_ready_end = 0;
+    }
+    m_window_start = offset - offset % file_cache::WINDOW_SIZE;
+    m_window_len = min((size_t)(entry->st.st_size - m_window_start), file_cache::WINDOW_SIZE);
+    m_window = (char *)mmap(0, m_window_len, PROT_READ, MAP_PRIVATE, entry->fd, entry->base + m_window_start);
+    if (m_window == MAP_FAILED)
+    {
+        m_window = 0;
+        return false;
+    }
+    madvise(m_window, m_window_len, MADV_SEQUENTIAL);
+    return true;
+}
 
-        free(m_url_real);
+//addr开始的len字节是否全部在页缓存中，addr必须按页对齐
+static bool page_resident(const char *addr, size_t len)
+{
+    static const long page = sysconf(_SC_PAGESIZE);
+    unsigned char vec[512];
+    size_t chunk = sizeof(vec) * page;
+    for (size_t off = 0; off < len; off += chunk)
+    {
+        size_t n = min(chunk, len - off);
+        if (mincore((void *)(addr + off), n, vec) < 0)
+            return true;    //无法判断时按已在内存处理，不影响发送
+        for (size_t i = 0; i < (n + page - 1) / page; ++i)
+        {
+            if (!(vec[i] & 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+//发送文件内容之前检查它是否已在页缓存中，不在时交给I/O线程预读，本线程不阻塞在磁盘读上
+//有整体映射的文件确认一次后记在缓存条目上，writev与sendfile方式都一样
+//没有整体映射的大文件按窗口检查，确认当前窗口后顺带提示内核预读下一个窗口
+bool http_conn::file_ready()
+{
+    io_pool *pool = io_pool::get_instance();
+    if (m_segments.empty() || !pool->enabled())
+        return true;
+    if (m_io_done)
+    {
+        m_io_done = false;
+        return true;
+    }
+    //头部等借用的内存排在前面，gather会把它们和后面的文件映射放进同一次sendmsg，要检查的是映射
+    const response_segments::segment *first = m_segments.first_entry();
+    if (!first)
+        return true;
+    const response_segments::segment &s = *first;
+    file_entry *entry = s.entry;
+    if (entry->fd == -1)
+        return true;
+
+    off_t offset;
+    size_t len;
+    off_t size = entry->st.st_size;
+    //内存段只检查文件的整体映射，预先生成的完整应答在堆上
+    if (s.type == response_segments::SEG_MEMORY &&
+        (!entry->addr || s.data < entry->addr || s.data >= entry->addr + size))
+        return true;
+    //缓存条目已有整体映射时直接用它检查，sendfile发送的文件段也一样，不再为每个应答映射窗口
+    if (entry->addr)
+    {
+        if (entry->resident.load(memory_order_relaxed))
+            return true;
+        if (page_resident(entry->addr, size))
+        {
+            entry->resident.store(true, memory_order_relaxed);
+            return true;
+        }
+        offset = 0;
+        len = size;
     }
-    //如果以上均不符合，即不是登录和注册，直接将url与网站目录拼接
-    //这里的情况是welcome界面，请求服务器上的一个图片
     else
-        strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
+    {
+        if (entry == m_window_file && s.offset < m_ready_end)
+            return true;
+        if (!map_window(entry, s.offset))
+            return true;
+        off_t window_end = m_window_start + m_window_len;
+        if (page_resident(m_window, m_window_len))
+        {
+            m_ready_end = window_end;
+            if (window_end < size)
+                posix_fadvise(entry->fd, entry->base + window_end, file_cache::WINDOW_SIZE, POSIX_FADV_WILLNEED);
+            return true;
+        }
+        offset = m_window_start;
+        len = m_window_len;
+    }
 
-    // 获取m_real_file文件的相关的状态信息，-1失败，0成功
-    if (stat(m_real_file, &m_file_stat) < 0)    
-        return NO_RESOURCE;                     //文件不存在
-    
-    //判断访问权限
-    if (!(m_file_stat.st_mode & S_IROTH))       //无读权限
-        return FORBIDDEN_REQUEST;
+    io_request request = {entry, offset, len, m_sockfd, m_io_ticket};
+    file_cache::get_instance()->retain(entry);
+    if (!pool->submit(request))
+    {
+        file_cache::get_instance()->release(entry);
+        return true;
+    }
+    m_io_wait = true;
+    return false;
+}
 
-    if (S_ISDIR(m_file_stat.st_mode))           //判断是否是目录  
-        return BAD_REQUEST;
-    
-    //创建内存映射
-    int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
-    return FILE_REQUEST;
+void http_conn::resume_write(unsigned ticket)
+{
+    if (m_sockfd == -1 || !m_io_wait || ticket != m_io_ticket)
+        return;
+    m_io_wait = false;
+    //等待期间没有发送，提交预读的仍是第一个引用缓存条目的段
+    //I/O线程读完后再确认一次，确认过的内容记下，之后不再检查
+    const response_segments::segment &s = *m_segments.first_entry();
+    if (s.entry->addr)
+    {
+        if (page_resident(s.entry->addr, s.entry->st.st_size))
+            s.entry->resident.store(true, memory_order_relaxed);
+    }
+    else if (m_window && s.entry == m_window_file && page_resident(m_window, m_window_len))
+        m_ready_end = m_window_start + m_window_len;
+    //仍未确认(读完后又被换出、读取失败或文件被截短)时照常发送这一次，不反复预读同一段
+    m_io_done = true;
+    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
 }
 
-// 释放内存映射
-void http_conn::unmap()
+//文件整体映射中足够大的一段零拷贝发送
+//只用于有描述符的文件：映射的是页缓存，发送完成前即使条目被释放页也不会被复用
+//内存中压缩生成的版本释放后内存可能被重新分配，不走零拷贝
+bool http_conn::zerocopy_segment(const response_segments::segment &s) const
 {
-    if(m_file_address)
+    file_entry *entry = s.entry;
+    return m_zerocopy && s.type == response_segments::SEG_MEMORY && entry && entry->fd != -1 &&
+           entry->addr && s.data >= entry->addr && s.data < entry->addr + entry->st.st_size &&
+           s.len >= m_zerocopy_threshold &&
+           (m_zc_count < MAX_ZEROCOPY_HOLD ||
+            m_zc_hold[(m_zc_head + m_zc_count - 1) % MAX_ZEROCOPY_HOLD].entry == entry);
+}
+
+//记录一次成功的零拷贝发送，连续发送同一文件时合并为一项
+void http_conn::hold_zerocopy(file_entry *entry)
+{
+    ++m_zc_seq;
+    if (m_zc_count)
     {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+        zerocopy_hold &last = m_zc_hold[(m_zc_head + m_zc_count - 1) % MAX_ZEROCOPY_HOLD];
+        if (last.entry == entry)
+        {
+            last.end = m_zc_seq;
+            return;
+        }
     }
+    zerocopy_hold &hold = m_zc_hold[(m_zc_head + m_zc_count) % MAX_ZEROCOPY_HOLD];
+    hold.end = m_zc_seq;
+    hold.entry = entry;
+    file_cache::get_instance()->retain(entry);
+    ++m_zc_count;
+}
+
+//序号done之前的发送已全部完成，TCP按顺序完成，释放对应的文件
+void http_conn::release_zerocopy(unsigned done)
+{
+    while (m_zc_count && (int)(done - m_zc_hold[m_zc_head].end) >= 0)
+    {
+        file_cache::get_instance()->release(m_zc_hold[m_zc_head].entry);
+        m_zc_head = (m_zc_head + 1) % MAX_ZEROCOPY_HOLD;
+        --m_zc_count;
+    }
+}
+
+bool http_conn::reap_zerocopy()
+{
+    if (m_sockfd == -1 || !m_zc_seq)
+        return false;
+    bool reaped = false;
+    while (true)
+    {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(m_sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+        {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+                continue;
+            struct sock_extended_err *err = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            //通知覆盖序号[ee_info, ee_data]
+            reaped = true;
+            release_zerocopy(err->ee_data + 1);
+            //内核实际做了拷贝(如回环接口)，零拷贝只剩额外开销，这个连接之后不再使用
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                m_zerocopy = false;
+        }
+    }
+    return reaped;
+}
+
+void http_conn::rearm()
+{
+    if (m_sockfd == -1 || m_io_wait)
+        return;
+    modfd(m_epollfd, m_sockfd, bytes_to_send > 0 ? EPOLLOUT : EPOLLIN, m_TRIGMode);
 }
 
 //响应报文写入函数，服务器子线程调用process_write完成响应报文，随后注册epollout事件。
 //服务器主线程检测写事件，并调用http_conn::write函数将响应报文发送给浏览器端。
 bool http_conn::write()
 {
-    int temp = 0;
+    ssize_t temp = 0;
 
     //若要发送的数据长度为0
     //表示响应报文为空，一般不会出现这种情况
@@ -618,8 +1473,48 @@ bool http_conn::write()
 
     while (1)
     {
-        //将响应报文的状态行、消息头、空行和响应正文发送给浏览器端
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        //文件内容不在页缓存中时先交给I/O线程读入，完成后由主线程重新注册写事件
+        if (!file_ready())
+            return true;
+        //连续的内存段聚集后一次sendmsg发出，文件段单独发送
+        //后面还有数据时带上MSG_MORE，让头部与应答体开头合并到同一个报文段
+        const response_segments::segment &s = m_segments.front();
+        int flags = 0;
+        if (s.type == response_segments::SEG_FILE)
+        {
+            if (m_segments.count() > 1)
+                flags |= MSG_MORE;
+            temp = send_file(s, flags);
+            //文件在发送期间被截短，sendfile读到文件末尾返回0，剩余的内容再也发不出去，关闭连接
+            if (temp == 0)
+            {
+                unmap();
+                return false;
+            }
+        }
+        else
+        {
+            //零拷贝的段由gather单独成批：头部在m_response中，下一个应答会覆盖，不能交给内核异步读取
+            struct iovec iov[response_segments::MAX_BATCH];
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = m_segments.gather(iov, response_segments::MAX_BATCH,
+                                               m_zerocopy ? m_zerocopy_threshold : 0);
+            if (zerocopy_segment(s))
+                flags |= MSG_ZEROCOPY;
+            if (m_segments.count() > msg.msg_iovlen)
+                flags |= MSG_MORE;
+            temp = sendmsg(m_sockfd, &msg, flags);
+            //超出可锁定的内存上限时退回普通发送
+            if (temp < 0 && errno == ENOBUFS && (flags & MSG_ZEROCOPY))
+            {
+                flags &= ~MSG_ZEROCOPY;
+                temp = sendmsg(m_sockfd, &msg, flags);
+            }
+            if (temp > 0 && (flags & MSG_ZEROCOPY))
+                hold_zerocopy(s.entry);
+        }
         //发送失败
         if (temp < 0)
         {   
@@ -635,22 +1530,11 @@ bool http_conn::write()
             return false;
         }
         //正常发送，temp为发送的字节数
+        m_send_progress = coarse_clock::get_instance()->now_ms();
         bytes_have_send += temp;
         bytes_to_send -= temp;
-        //iovec1 响应报文部分已写完
-        if (bytes_have_send >= m_iv[0].iov_len)
-        {
-            //不再继续发送头部信息
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        }
-        else
-        {   
-            //继续发送头部信息
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
+        //跳过已发送的部分，可能停在某一段的中间
+        m_segments.consume(temp);
         //数据已全部发送完
         if (bytes_to_send <= 0)
         {
@@ -671,122 +1555,303 @@ bool http_conn::write()
     }
 }
 
-// 往写缓冲中写入待发送的数据
-bool http_conn::add_response(const char *format, ...)
+//添加消息报头，具体的添加文本长度、连接状态和空行
+bool http_conn::add_headers(long long content_len, bool date)
 {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)
-        return false;
-    //定义可变参数列表
-    va_list arg_list;
-
-    //将变量arg_list初始化为传入参数
-    va_start(arg_list, format);
-
-    //将数据format从可变参数列表写入缓冲区写，返回写入数据的长度
-    int len=vsnprintf(m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - m_write_idx - 1, format, arg_list);
-
-    //如果写入的数据长度超过缓冲区剩余空间，则报错
-    if (len >= (WRITE_BUFFER_SIZE - 1 - m_write_idx))
-    {
-        va_end(arg_list);
-        return false;
-    }
-
-    //更新m_write_idx位置
-    m_write_idx += len;
-    //清空可变参列表
-    va_end(arg_list);
-
-    LOG_INFO("request:%s", m_write_buf);
-    return true;
+    if (date)
+        add_date();
+    m_response.header(HEADER_CONTENT_LENGTH, content_len)
+              .header(HEADER_CONNECTION, m_linger ? "keep-alive" : "close")
+              .end_headers();
+    return m_response.ok();
 }
-//添加状态行
-bool http_conn::add_status_line(int status, const char *title)
+//Date头部，使用时钟每秒格式化一次的日期
+bool http_conn::add_date()
 {
-    return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
+    char date[coarse_clock::HTTP_DATE_LEN];
+    size_t len = coarse_clock::get_instance()->http_date(date);
+    m_response.header(HEADER_DATE, std::string_view(date, len));
+    return m_response.ok();
 }
-//添加消息报头，具体的添加文本长度、连接状态和空行
-bool http_conn::add_headers(int content_len)
+//错误页面的完整应答
+bool http_conn::add_error(int status, const char *form)
 {
-    return add_content_length(content_len) && add_linger() &&
-           add_blank_line();
+    size_t len = strlen(form);
+    m_response.status(status);
+    if (!add_headers(len))
+        return false;
+    m_response.append(std::string_view(form, len));
+    return m_response.ok();
 }
-//添加Content-Length，表示响应报文的长度
-bool http_conn::add_content_length(int content_len)
+//文件应答的状态行、类型、校验器、缓存策略及内容编码相关头部
+//304应答不带应答体，content_type传空
+bool http_conn::add_file_status(int status, std::string_view content_type)
 {
-    return add_response("Content-Length:%d\r\n", content_len);
+    m_response.status(status);
+    if (!content_type.empty())
+        m_response.header(HEADER_CONTENT_TYPE, content_type);
+    m_response.header(HEADER_ACCEPT_RANGES, "bytes")
+              .header(HEADER_ETAG, m_file->etag)
+              .header(HEADER_LAST_MODIFIED, m_file->last_modified)
+              .header(HEADER_CACHE_CONTROL, m_cache_control);
+    //压缩版本需要告知编码，可压缩资源的缓存需按Accept-Encoding区分
+    if (m_content_encoding)
+        m_response.header(HEADER_CONTENT_ENCODING, m_content_encoding);
+    if (m_vary)
+        m_response.header(HEADER_VARY, "Accept-Encoding");
+    return m_response.ok();
 }
-//添加文本类型，这里是html
-bool http_conn::add_content_type()
+
+//生成Content-Range的值"bytes first-last/size"，first为-1时生成"bytes */size"
+static std::string_view content_range(char *buf, size_t cap, off_t first, off_t last, off_t size)
 {
-    return add_response("Content-Type:%s\r\n","text/html");
+    char *p = buf;
+    char *end = buf + cap;
+    memcpy(p, "bytes ", 6);
+    p += 6;
+    if (first < 0)
+        *p++ = '*';
+    else
+    {
+        p = std::to_chars(p, end, (long long)first).ptr;
+        *p++ = '-';
+        p = std::to_chars(p, end, (long long)last).ptr;
+    }
+    *p++ = '/';
+    p = std::to_chars(p, end, (long long)size).ptr;
+    return std::string_view(buf, p - buf);
 }
-//添加连接状态，通知浏览器端是保持连接还是关闭
-bool http_conn::add_linger()
+
+//多范围应答的分隔符，16位十六进制随机串
+static void make_boundary(char *buf)
 {
-    return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
+    static std::atomic<unsigned long long> counter(0);
+    unsigned long long x = counter.fetch_add(1, std::memory_order_relaxed) + (unsigned long long)coarse_clock::get_instance()->now() * 0x9E3779B97F4A7C15ULL;
+    //splitmix64
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 16; ++i)
+        buf[i] = hex[(x >> (i * 4)) & 0xF];
 }
-//添加空行
-bool http_conn::add_blank_line()
+
+//206应答，文件片段直接指向映射区或由sendfile从对应偏移发送，不做拷贝
+bool http_conn::add_ranges()
 {
-    return add_response("%s", "\r\n");
+    char value[96];
+    off_t size = m_file_stat.st_size;
+    if (m_range_count == 1)
+    {
+        const byte_range &r = m_ranges[0];
+        off_t len = r.last - r.first + 1;
+        add_file_status(206, m_file->content_type);
+        m_response.header(HEADER_CONTENT_RANGE, content_range(value, sizeof(value), r.first, r.last, size));
+        if (!add_headers(len))
+            return false;
+        m_segments.add(m_response.data(), m_response.size());
+        add_body(r.first, len);
+        bytes_to_send = m_segments.bytes();
+        return true;
+    }
+
+    //multipart/byteranges，各段的分隔头先写入m_response，应答头部写在其后
+    //写入过程中缓冲区可能扩容，因此先记录偏移，全部写完后再加入各段
+    char boundary[16];
+    make_boundary(boundary);
+    std::string_view b(boundary, sizeof(boundary));
+    size_t part_offset[MAX_RANGES + 1];
+    off_t body_len = 0;
+    for (int i = 0; i < m_range_count; ++i)
+    {
+        const byte_range &r = m_ranges[i];
+        part_offset[i] = m_response.size();
+        m_response.append("\r\n--").append(b).append("\r\n")
+                  .header(HEADER_CONTENT_TYPE, m_file->content_type)
+                  .header(HEADER_CONTENT_RANGE, content_range(value, sizeof(value), r.first, r.last, size))
+                  .end_headers();
+        body_len += r.last - r.first + 1;
+    }
+    part_offset[m_range_count] = m_response.size();
+    m_response.append("\r\n--").append(b).append("--\r\n");
+    size_t head_offset = m_response.size();
+    body_len += head_offset;
+
+    memcpy(value, "multipart/byteranges; boundary=", 31);
+    memcpy(value + 31, boundary, sizeof(boundary));
+    add_file_status(206, std::string_view(value, 31 + sizeof(boundary)));
+    if (!add_headers(body_len))
+        return false;
+
+    const char *base = m_response.data();
+    m_segments.add(base + head_offset, m_response.size() - head_offset);
+    for (int i = 0; i < m_range_count; ++i)
+    {
+        m_segments.add(base + part_offset[i], part_offset[i + 1] - part_offset[i]);
+        add_body(m_ranges[i].first, m_ranges[i].last - m_ranges[i].first + 1);
+    }
+    m_segments.add(base + part_offset[m_range_count], head_offset - part_offset[m_range_count]);
+    bytes_to_send = m_segments.bytes();
+    return true;
 }
-//添加文本content
-bool http_conn::add_content(const char *content)
+
+//小文件的完整应答(头部+文件内容)挂在缓存条目上，按keep-alive与否各生成一次，之后所有请求共享
+bool http_conn::add_prerendered()
 {
-    return add_response("%s", content);
+    file_cache *cache = file_cache::get_instance();
+    size_t len = 0;
+    const char *data = cache->get_response(m_file, m_linger, len);
+    if (!data)
+    {
+        if (!add_file_status(200, m_file->content_type) || !add_headers(m_file_stat.st_size, false))
+            return false;
+        len = m_response.size() + m_file_stat.st_size;
+        char *buf = (char *)malloc(len);
+        if (!buf)
+            return false;
+        memcpy(buf, m_response.data(), m_response.size());
+        memcpy(buf + m_response.size(), m_file_address, m_file_stat.st_size);
+        data = cache->set_response(m_file, m_linger, buf, len);
+    }
+    //缓存的应答不含Date，插在状态行之后
+    size_t status_len = status_line(200).size();
+    m_response.clear();
+    if (!add_date())
+        return false;
+    m_segments.add_shared(m_file, data, status_len);
+    m_segments.add(m_response.data(), m_response.size());
+    m_segments.add_shared(m_file, data + status_len, len - status_len);
+    bytes_to_send = m_segments.bytes();
+    return true;
 }
-//向m_write_buf写入响应报文数据
+
+//sendfile模式或没有整体映射的大文件作为文件段发送，否则直接引用整体映射；内存中压缩生成的版本没有描述符
+void http_conn::add_body(off_t offset, size_t len)
+{
+    if ((m_sendfile && m_file->fd != -1) || !m_file_address)
+        m_segments.add_file(m_file, offset, len);
+    else
+        m_segments.add_shared(m_file, m_file_address + offset, len);
+}
+
+//生成响应报文头部，应答体尽量直接指向已有的内存或文件
 bool http_conn::process_write(HTTP_CODE ret)
 {
+    m_send_progress = coarse_clock::get_instance()->now_ms();
     switch (ret)
     {
     //内部错误，500    
     case INTERNAL_ERROR:
     {
-        //状态行
-        add_status_line(500, error_500_title);
-        //消息报头
-        add_headers(strlen(error_500_form));
-        if (!add_content(error_500_form))
+        if (!add_error(500, error_500_form))
+            return false;
+        break;
+    }
+    //请求头过大，读缓冲区中还有未解析的头部，只能关闭连接
+    case HEADER_TOO_LARGE:
+    {
+        m_linger = false;
+        if (!add_error(431, error_431_form))
+            return false;
+        break;
+    }
+    //请求非法或请求体过大，请求体可能没有读取，只能关闭连接
+    case MALFORMED_REQUEST:
+    {
+        m_linger = false;
+        if (!add_error(400, error_400_form))
+            return false;
+        break;
+    }
+    case BODY_TOO_LARGE:
+    {
+        m_linger = false;
+        if (!add_error(413, error_413_form))
             return false;
         break;
     }
     //报文语法有误，404
     case BAD_REQUEST:
     {
-        add_status_line(404, error_404_title);
-        add_headers(strlen(error_404_form));
-        if (!add_content(error_404_form))
+        if (!add_error(404, error_404_form))
             return false;
         break;
     }
     //资源没有访问权限，403
     case FORBIDDEN_REQUEST:
     {
-        add_status_line(403, error_403_title);
-        add_headers(strlen(error_403_form));
-        if (!add_content(error_403_form))
+        if (!add_error(403, error_403_form))
+            return false;
+        break;
+    }
+    //JSON接口应答，应答体已由处理函数生成在m_json_buf中
+    case JSON_REQUEST:
+    {
+        m_response.status(m_json_status).header(HEADER_CONTENT_TYPE, "application/json");
+        if (!add_headers(m_json_len))
+            return false;
+        m_segments.add(m_response.data(), m_response.size());
+        m_segments.add(m_json_buf, m_json_len);
+        bytes_to_send = m_segments.bytes();
+        return true;
+    }
+    //模板页面，值随请求变化，不允许缓存
+    case TEMPLATE_REQUEST:
+    {
+        size_t len = m_template->length(m_template_values);
+        m_response.status(200)
+                  .header(HEADER_CONTENT_TYPE, "text/html; charset=utf-8")
+                  .header(HEADER_CACHE_CONTROL, "no-store");
+        if (!add_headers(len))
+            return false;
+        m_segments.add(m_response.data(), m_response.size());
+        if (!m_template->render(m_template_values, m_segments))
+            return false;
+        bytes_to_send = m_segments.bytes();
+        return true;
+    }
+    //客户端缓存仍然有效，304只有头部
+    case NOT_MODIFIED:
+    {
+        add_file_status(304, std::string_view());
+        add_date();
+        m_response.header(HEADER_CONNECTION, m_linger ? "keep-alive" : "close").end_headers();
+        if (!m_response.ok())
+            return false;
+        break;
+    }
+    //字节范围请求，206
+    case PARTIAL_CONTENT:
+        return add_ranges();
+    //请求的范围全部超出文件，416
+    case RANGE_NOT_SATISFIABLE:
+    {
+        char value[64];
+        m_response.status(416)
+                  .header(HEADER_CONTENT_RANGE, content_range(value, sizeof(value), -1, 0, m_file_stat.st_size));
+        if (!add_headers(0))
             return false;
         break;
     }
     //文件存在，200
     case FILE_REQUEST:
     {
-        add_status_line(200, ok_200_title);
+        //小文件直接使用预先生成的完整应答，一次write发出
+        if (m_file_stat.st_size != 0 && m_file_stat.st_size <= m_prerender_size &&
+            file_cache::get_instance()->enabled())
+            return add_prerendered();
+
+        add_file_status(200, m_file->content_type);
         //如果请求的资源存在
         if (m_file_stat.st_size != 0)
         {
-            add_headers(m_file_stat.st_size);
-            //第一个iovec指针指向响应报文缓冲区，长度指向m_write_idx
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            //第二个iovec指针指向mmap返回的文件指针，长度指向文件大小
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
+            if (!add_headers(m_file_stat.st_size))
+                return false;
+            //第一段是响应报文头部，之后是文件内容
+            m_segments.add(m_response.data(), m_response.size());
+            add_body(0, m_file_stat.st_size);
             //发送的全部数据为响应报文头部信息和文件大小
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            bytes_to_send = m_segments.bytes();
             return true;
         }
         else
@@ -794,29 +1859,36 @@ bool http_conn::process_write(HTTP_CODE ret)
             //如果请求的资源大小为0，则返回空白html文件
             const char *ok_string = "<html><body></body></html>";
             add_headers(strlen(ok_string));
-            if (!add_content(ok_string))
+            m_response.append(ok_string);
+            if (!m_response.ok())
                 return false;
         }
     }
     default:
         return false;
     }
-    //除FILE_REQUEST状态外，其余状态只申请一个iovec，指向响应报文缓冲区
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+    //除FILE_REQUEST状态外，其余状态的应答只有一段，即响应报文缓冲区
+    m_segments.add(m_response.data(), m_response.size());
+    bytes_to_send = m_segments.bytes();
     return true;
 }
 // 由线程池中的工作线程调用，这是处理HTTP请求的入口函数
 void http_conn::process()
 {
-    // 解析HTTP请求
-    HTTP_CODE read_ret = process_read();
+    // 解析HTTP请求，主线程已解析完的请求直接执行处理函数
+    HTTP_CODE read_ret;
+    if (m_deferred)
+    {
+        m_deferred = false;
+        read_ret = do_request();
+    }
+    else
+        read_ret = process_read();
     if(read_ret == NO_REQUEST)
     {
-        //注册并监听读事件
+        //注册并监听读事件，等待请求剩余部分
         modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return;
     }
     // 生成响应
     bool write_ret = process_write(read_ret);
@@ -826,4 +1898,25 @@ void http_conn::process()
     }
     //注册并监听写事件
     modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
-}
\ No newline at end of file
+}
+
+http_conn::INLINE_RESULT http_conn::process_inline()
+{
+    //只处理新请求，且请求行和头部已经完整，POST请求需要读取请求体，直接交给线程池
+    if (m_check_state != CHECK_STATE_REQUESTLINE || m_read_idx < 5 ||
+        strncasecmp(m_read_buf, "POST ", 5) == 0 ||
+        !memmem(m_read_buf, m_read_idx, "\r\n\r\n", 4))
+        return INLINE_DEFER;
+
+    m_inline = true;
+    HTTP_CODE read_ret = process_read();
+    m_inline = false;
+    if (read_ret == DEFER_REQUEST)
+        return INLINE_DEFER;
+    if (read_ret == NO_REQUEST)
+    {
+        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        return INLINE_WAIT;
+    }
+    return process_write(read_ret) ? INLINE_WRITE : INLINE_CLOSE;
+}
@@ -19,12 +19,37 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <map>
 
 #include "../lock/locker.h"
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "../cache/file_cache.h"
+#include "../cache/io_pool.h"
+#include "form_parser.h"
+#include "json_parser.h"
+#include "router.h"
+#include "response_builder.h"
+#include "response_segments.h"
+#include "html_template.h"
+#include "mime_types.h"
+#include "cache_policy.h"
+
+//连接各阶段的期限与请求头的限制
+//请求行和头部从第一个字节起必须在header_timeout内收完，不因陆续到达的数据延长
+//请求体在header_timeout的宽限之后按body_rate计算，每收到body_rate字节多给1秒
+struct conn_limits
+{
+    int header_timeout;     //请求行与头部，秒
+    int body_rate;          //请求体的最低速率，字节/秒，0表示只要有数据到达就按idle_timeout延长
+    int idle_timeout;       //长连接等待下一个请求，秒
+    int write_timeout;      //发送应答时连续没有进展，秒
+    int max_headers;        //请求头的最多行数
+    int max_header_size;    //请求行与头部的总字节数，不超过读缓冲区
+    long max_body_size;     //请求体的最大字节数
+};
 
 //激发http连接数 最大数量对应于最大fd
 class http_conn
@@ -32,7 +57,11 @@ class http_conn
 public:
     static const int FILENAME_LEN = 200;        //设置读取文件的名称m_real_file大小
     static const int READ_BUFFER_SIZE=2048;     //设置读缓冲区m_read_buf大小
-    static const int WRITE_BUFFER_SIZE=1024;    //设置写缓冲区m_write_buf大小
+    static const int JSON_BUFFER_SIZE=256;      //JSON接口应答体m_json_buf大小
+    static const int MAX_RANGES = 8;            //一个请求最多响应的字节范围数，超出时忽略Range返回整个文件
+    static const int MAX_ZEROCOPY_HOLD = 8;     //等待内核完成通知的零拷贝发送最多涉及的文件数
+    static const int TEMPLATE_PAGE_COUNT = 3;
+    static const char *const template_pages[TEMPLATE_PAGE_COUNT];   //处理函数用render_page渲染的页面
     //HTTP报文的请求方法，本项目只用到GET和POST
     enum METHOD
     {
@@ -62,8 +91,38 @@ public:
         NO_RESOURCE,
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
+        JSON_REQUEST,
+        NOT_MODIFIED,
+        PARTIAL_CONTENT,
+        RANGE_NOT_SATISFIABLE,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        TEMPLATE_REQUEST,   //由模板生成的页面
+        HEADER_TOO_LARGE,   //请求头超过行数或字节数限制，431
+        MALFORMED_REQUEST,  //请求头或表单非法，400
+        BODY_TOO_LARGE,     //请求体超过限制，413
+        DEFER_REQUEST       //主线程上无法快速完成，交给线程池
+    };
+    //主线程直接处理请求的结果
+    enum INLINE_RESULT
+    {
+        INLINE_DEFER = 0,   //需要交给线程池
+        INLINE_WAIT,        //请求不完整，已重新注册读事件
+        INLINE_WRITE,       //应答已生成，可以立即发送
+        INLINE_CLOSE        //生成应答失败，需要关闭连接
+    };
+    //注册结果
+    enum REGISTER_RESULT
+    {
+        REGISTER_OK = 0,
+        REGISTER_EXISTS,
+        REGISTER_FAILED
+    };
+    //Range请求中的一个字节范围，闭区间[first, last]
+    struct byte_range
+    {
+        off_t first;
+        off_t last;
     };
     //从状态机的状态
     enum LINE_STATUS
@@ -72,10 +131,19 @@ public:
         LINE_BAD,
         LINE_OPEN
     };
+    //一段尚未完成的零拷贝发送，内核报告序号end之前的发送全部完成后释放entry
+    struct zerocopy_hold
+    {
+        unsigned end;
+        file_entry *entry;
+    };
 
 public:
-    http_conn() {}
-    ~http_conn() {}
+    http_conn() : m_file(0), m_file_address(0), m_body_fd(-1), m_window(0), m_io_ticket(0), m_zc_seq(0), m_zc_head(0), m_zc_count(0)
+    {
+        m_body_pipe[0] = m_body_pipe[1] = -1;
+    }
+    ~http_conn() { close_body(); }
 
 public:
     //初始化套接字地址，函数内部会调用私有方法init
@@ -84,6 +152,9 @@ public:
     void close_conn(bool real_close = true);
     //主从状态机 报文解析
     void process();
+    //proactor模式下主线程读完数据后调用，缓存命中的静态文件请求和简单的错误应答直接生成
+    //需要数据库、请求体或磁盘读取的请求返回INLINE_DEFER，由线程池接着处理
+    INLINE_RESULT process_inline();
     //读取浏览器端发来的全部数据，循环读取客户数据，直到无数据可读或对方关闭连接
     bool read_once();
     //响应报文写入函数
@@ -93,6 +164,14 @@ public:
     { 
         return &m_address; 
     }
+    //预读完成后由主线程调用，ticket仍匹配时重新注册写事件
+    void resume_write(unsigned ticket);
+    //读取socket错误队列中的零拷贝完成通知并释放对应的文件，队列中没有这类通知时返回false
+    bool reap_zerocopy();
+    //EPOLLERR只是完成通知时，按连接当前的状态重新注册EPOLLONESHOT事件
+    void rearm();
+    //按连接当前所处的阶段计算超时时间，now为单调时钟的毫秒数
+    long long deadline(long long now) const;
     //同步线程初始化数据库读取表
     void initmysql_result(connection_pool *connPool);
     //只在Reactor模式下发挥作用
@@ -103,7 +182,7 @@ private:
     void init();
     //从m_read_buf读取，并处理请求报文
     HTTP_CODE process_read();
-    //向m_write_buf写入响应报文数据
+    //生成响应报文
     bool process_write(HTTP_CODE ret);
     //主状态机解析报文中的请求行数据
     HTTP_CODE parse_request_line(char *text);
@@ -111,30 +190,74 @@ private:
     HTTP_CODE parse_headers(char *text);
     //主状态机解析报文中的请求内容
     HTTP_CODE parse_content(char *text);
-    //请求报文响应函数
+    //请求报文响应函数，按路由表分发请求
+    typedef HTTP_CODE (http_conn::*route_handler)(const char *);
+    const route<route_handler> *find_route() const;
     HTTP_CODE do_request();
+    //路由处理函数，参数为路由表中登记的target
+    HTTP_CODE serve_page(const char *path);
+    //以values填充模板path，path不是模板时按普通文件处理
+    HTTP_CODE render_page(const char *path, const template_value *values, int count);
+    HTTP_CODE do_login(const char *);
+    HTTP_CODE do_register(const char *);
+    HTTP_CODE api_login(const char *);
+    HTTP_CODE api_register(const char *);
+    //登录注册的公共逻辑，表单接口与JSON接口共用
+    bool check_user(const string &name, const string &password);
+    REGISTER_RESULT register_user(const string &name, const string &password);
+    bool parse_credentials(std::string_view &name, std::string_view &password);
+    void json_reply(int status, bool ok, const char *error, std::string_view name = std::string_view());
+    //解析请求体与查询串中的表单字段
+    bool parse_form();
+    static bool valid_credential(std::string_view s);
+    //解析Accept-Encoding
+    unsigned parse_accept_encoding(const char *text);
+    //条件请求，客户端缓存的版本仍然有效时返回true
+    bool not_modified() const;
+    //解析Range，结果为PARTIAL_CONTENT、RANGE_NOT_SATISFIABLE或按整个文件处理的FILE_REQUEST
+    HTTP_CODE check_range();
+    //大请求体转存到临时文件
+    bool open_body();
+    bool read_body();
+    void close_body_pipe();
+    void close_body();
 
     //m_start_line是已经解析的字符
     //get_line用于将指针向后偏移，指向未处理的字符
     char *get_line(){ return m_read_buf + m_start_line; };
     //从状态机读取一行，分析是请求报文的哪一部分
     LINE_STATUS parse_line();
-    //申请IO映射
+    //释放目标文件
     void unmap();
-    //根据响应报文格式，生成对应8个部分，以下函数均由do_request调用
-    bool add_response(const char *format, ...); //可变参数
-    bool add_content(const char *content);
-    bool add_status_line(int status, const char *title);
-    bool add_headers(int content_length);
-    bool add_content_type();
-    bool add_content_length(int content_length);
-    bool add_linger();
-    bool add_blank_line();
+    //发送文件段的开头，sendfile或分段映射
+    ssize_t send_file(const response_segments::segment &s, int flags);
+    bool map_window(file_entry *entry, off_t offset);
+    //待发送的文件内容是否已在页缓存中，不在时提交预读并返回false
+    bool file_ready();
+    //生成响应报文，以下函数均由process_write调用
+    //date为false时不带Date头部，用于缓存的完整应答，发送时再插入
+    bool add_headers(long long content_length, bool date = true);
+    bool add_date();
+    bool add_error(int status, const char *form);
+    bool add_file_status(int status, std::string_view content_type);
+    bool add_ranges();
+    bool add_prerendered();
+    //文件[offset, offset+len)作为应答体的一段
+    void add_body(off_t offset, size_t len);
+    //该段是否走零拷贝发送
+    bool zerocopy_segment(const response_segments::segment &s) const;
+    void hold_zerocopy(file_entry *entry);
+    void release_zerocopy(unsigned done);
 
 public:
     static int m_epollfd;       // 所有socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态的
     static int m_user_count;    // 统计用户的数量
-    MYSQL *mysql;
+    static long m_upload_threshold;     // 请求体超过该字节数时转存到临时文件
+    static const char *m_upload_dir;    // 临时文件所在目录
+    static bool m_sendfile;             // 文件内容是否通过sendfile发送
+    static long m_prerender_size;       // 不超过该大小的文件缓存完整应答，0表示不缓存
+    static size_t m_zerocopy_threshold; // 内存中的应答体不小于该字节数时用MSG_ZEROCOPY发送，0表示关闭
+    static conn_limits m_limits;        // 各阶段的超时与请求头限制
     int m_state;  //读为0, 写为1
 
 private:
@@ -145,10 +268,16 @@ private:
     long m_read_idx;                    // 缓冲区中m_read_buf中数据的最后一个字节的下一个位置
     long m_checked_idx;                 // 当前正在分析的字符在读缓冲区中的位置
     int m_start_line;                   // m_read_buf中已经解析的字符个数(当前正在解析的行的起始位置
+    int m_header_count;                 // 已解析的请求头行数
+
+    // 各阶段的起点，单调时钟的毫秒数
+    long long m_idle_start;             // 开始等待请求，即连接建立或上一个应答发送完毕
+    long long m_request_start;          // 收到请求的第一个字节
+    long long m_body_start;             // 头部解析完毕，开始接收请求体
+    long long m_send_progress;          // 应答生成或最近一次发送出数据
 
-    // 写缓冲区,存储发出的响应报文数据
-    char m_write_buf[WRITE_BUFFER_SIZE]; 
-    int m_write_idx;                     // 指示buffer中的长度
+    // 响应报文头部，错误页面等短应答的正文也写在这里
+    response_builder m_response;
 
     // 主状态机状态
     CHECK_STATE m_check_state;
@@ -158,20 +287,57 @@ private:
 
     //以下为解析请求报文中对应的6个变量
     char *m_url;                       // 客户请求的目标文件的文件名
+    char *m_query;                     // url中?之后的查询串，没有则为NULL
     char m_real_file[FILENAME_LEN];    //客户请求的目标文件的完整路径，其内容等于 doc_root + m_url, doc_root是网站根目录
     char *m_version;                   // HTTP协议版本号，我们仅支持HTTP1.1 
     char *m_host;                      // 主机名 
-    int m_content_length;              // HTTP请求的消息总长度
+    long m_content_length;             // HTTP请求的消息总长度
     bool m_linger;                     // HTTP请求是否要求保持连接
+    char *m_content_type;              // 请求体类型
 
+    file_entry *m_file;         //从文件缓存中取得的目标文件，发送完毕后释放
     char *m_file_address;       //客户请求的目标文件被mmap到内存中的起始位置
     struct stat m_file_stat;    //目标文件状态，通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct iovec m_iv[2];       //io向量机制iovec，我们将采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写内存块的数量。
-    int m_iv_count;         
-    int cgi;                    //是否启用的POST
-    char *m_string;             //存储请求体数据
-    int bytes_to_send;          //剩余发送字节数
-    int bytes_have_send;        //已发送字节数
+    response_segments m_segments;   //待发送的应答，头部、应答体的内存与文件片段按顺序排列
+    char *m_string;             //存储请求体数据，请求体转存到文件时为NULL
+    int m_body_fd;              //转存请求体的临时文件，请求完整后偏移量已回到文件头，处理函数直接读取
+    int m_body_pipe[2];         //socket到临时文件的splice管道
+    long m_body_received;       //已写入临时文件的请求体字节数
+    bool m_expect_continue;     //客户端是否在等待100 Continue
+    unsigned m_accept_encoding; //客户端可接受的内容编码，按1<<CONTENT_ENCODING置位
+    const char *m_content_encoding;     //应答体的内容编码，未压缩为NULL
+    bool m_vary;                //应答是否随Accept-Encoding变化
+    std::string_view m_cache_control;   //按路径确定的Cache-Control
+    char *m_if_none_match;      //If-None-Match，客户端缓存版本的ETag列表
+    char *m_if_modified_since;  //If-Modified-Since
+    char *m_range;              //Range，如bytes=0-499,1000-
+    char *m_if_range;           //If-Range，校验器不一致时忽略Range
+    byte_range m_ranges[MAX_RANGES];
+    int m_range_count;
+    const html_template *m_template;    //TEMPLATE_REQUEST使用的模板
+    std::string_view m_template_values[html_template::MAX_SLOTS];  //按槽下标排列的值，指向请求中的数据
+    form_parser m_form;         //查询串与表单字段
+    json_parser m_json;         //JSON请求体字段
+    char m_json_buf[JSON_BUFFER_SIZE];  //JSON应答体
+    int m_json_len;
+    int m_json_status;
+    long long bytes_to_send;    //剩余发送字节数
+    long long bytes_have_send;  //已发送字节数
+    char *m_window;             //没有整体映射的大文件当前映射的窗口
+    file_entry *m_window_file;  //窗口所属的文件，由m_segments持有引用
+    off_t m_window_start;
+    size_t m_window_len;
+    off_t m_ready_end;          //分段发送时m_window_file已确认在页缓存中的内容终点
+    unsigned m_io_ticket;       //每次请求重置或连接关闭时加一，用于丢弃过期的预读完成通知
+    bool m_io_wait;             //正在等待I/O线程预读
+    bool m_io_done;             //预读刚完成，下一次检查直接放行
+    bool m_inline;              //正在主线程上处理请求，遇到慢操作时返回DEFER_REQUEST
+    bool m_deferred;            //请求已解析完，线程池只需重新执行do_request
+    bool m_zerocopy;            //socket已开启SO_ZEROCOPY，内核退回拷贝后关闭
+    unsigned m_zc_seq;          //下一次零拷贝发送的序号，与内核的计数一致
+    zerocopy_hold m_zc_hold[MAX_ZEROCOPY_HOLD]; //按序号排列的环形队列
+    int m_zc_head;
+    int m_zc_count;
     char *doc_root;             
 
     map<string, string> m_users;
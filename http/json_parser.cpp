@@ -0,0 +1,483 @@
+#include "json_parser.h"
+#include <string.h>
+#include <charconv>
+
+//  --------------SWAR辅助函数----------
+//一次检查8个字节，判断其中是否含有引号、反斜杠或控制字符
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+static inline uint64_t has_zero_byte(uint64_t v)
+{
+    return (v - ONES) & ~v & HIGHS;
+}
+
+static inline bool has_special(uint64_t word)
+{
+    uint64_t quote = has_zero_byte(word ^ (ONES * '"'));
+    uint64_t slash = has_zero_byte(word ^ (ONES * '\\'));
+    uint64_t control = (word - ONES * 0x20) & ~word & HIGHS;
+    return quote | slash | control;
+}
+
+static inline int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static bool read_hex4(const char *p, uint32_t &code)
+{
+    code = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        int v = hex_value(p[i]);
+        if (v < 0)
+            return false;
+        code = (code << 4) | v;
+    }
+    return true;
+}
+
+//将码点编码为UTF-8，返回写入的字节数
+static int put_utf8(char *dst, uint32_t code)
+{
+    if (code < 0x80)
+    {
+        dst[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800)
+    {
+        dst[0] = (char)(0xC0 | (code >> 6));
+        dst[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000)
+    {
+        dst[0] = (char)(0xE0 | (code >> 12));
+        dst[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        dst[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    dst[0] = (char)(0xF0 | (code >> 18));
+    dst[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    dst[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    dst[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+//  --------------json_parser---------------------
+bool json_parser::parse(char *data, size_t len)
+{
+    m_cur = data;
+    m_end = data + len;
+    m_count = 0;
+
+    skip_space();
+    if (m_cur >= m_end || *m_cur != '{')
+        return false;
+    ++m_cur;
+    skip_space();
+    if (m_cur < m_end && *m_cur == '}')
+    {
+        ++m_cur;
+    }
+    else
+    {
+        while (true)
+        {
+            std::string_view key;
+            json_value value;
+            skip_space();
+            if (m_cur >= m_end || *m_cur != '"' || !parse_string(key))
+                return false;
+            skip_space();
+            if (m_cur >= m_end || *m_cur != ':')
+                return false;
+            ++m_cur;
+            if (!parse_value(value, 1))
+                return false;
+            //同名字段保留第一个，超出上限的字段只校验不保存
+            json_value existing;
+            if (m_count < MAX_FIELDS && !get(key, existing))
+            {
+                m_fields[m_count].key = key;
+                m_fields[m_count].value = value;
+                ++m_count;
+            }
+            skip_space();
+            if (m_cur >= m_end)
+                return false;
+            if (*m_cur == '}')
+            {
+                ++m_cur;
+                break;
+            }
+            if (*m_cur != ',')
+                return false;
+            ++m_cur;
+        }
+    }
+    skip_space();
+    return m_cur == m_end;
+}
+
+bool json_parser::get(std::string_view key, json_value &value) const
+{
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (m_fields[i].key == key)
+        {
+            value = m_fields[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool json_parser::get_string(std::string_view key, std::string_view &value) const
+{
+    json_value v;
+    if (!get(key, v) || v.type != JSON_STRING)
+        return false;
+    value = v.text;
+    return true;
+}
+
+void json_parser::skip_space()
+{
+    while (m_cur < m_end && (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\n' || *m_cur == '\r'))
+        ++m_cur;
+}
+
+bool json_parser::parse_value(json_value &value, int depth)
+{
+    skip_space();
+    if (m_cur >= m_end)
+        return false;
+
+    char *start = m_cur;
+    bool ok;
+    switch (*m_cur)
+    {
+    case '"':
+        value.type = JSON_STRING;
+        return parse_string(value.text);
+    case '{':
+        value.type = JSON_OBJECT;
+        ok = parse_container('}', depth + 1);
+        break;
+    case '[':
+        value.type = JSON_ARRAY;
+        ok = parse_container(']', depth + 1);
+        break;
+    case 't':
+        value.type = JSON_BOOL;
+        ok = parse_literal("true", 4);
+        break;
+    case 'f':
+        value.type = JSON_BOOL;
+        ok = parse_literal("false", 5);
+        break;
+    case 'n':
+        value.type = JSON_NULL;
+        ok = parse_literal("null", 4);
+        break;
+    default:
+        value.type = JSON_NUMBER;
+        ok = parse_number();
+        break;
+    }
+    value.text = std::string_view(start, m_cur - start);
+    return ok;
+}
+
+//m_cur指向起始引号，解析结束后指向结束引号之后
+//反转义后的结果不会比原文更长，因此可以就地写回
+bool json_parser::parse_string(std::string_view &out)
+{
+    char *start = ++m_cur;
+    char *dst = start;
+
+    while (true)
+    {
+        //快速跳过普通字符，dst落后于m_cur时整块前移
+        while (m_end - m_cur >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, m_cur, 8);
+            if (has_special(word))
+                break;
+            if (dst != m_cur)
+                memmove(dst, m_cur, 8);
+            m_cur += 8;
+            dst += 8;
+        }
+        if (m_cur >= m_end)
+            return false;
+
+        unsigned char c = *m_cur;
+        if (c == '"')
+        {
+            out = std::string_view(start, dst - start);
+            ++m_cur;
+            return true;
+        }
+        if (c < 0x20)
+            return false;
+        if (c != '\\')
+        {
+            *dst++ = (char)c;
+            ++m_cur;
+            continue;
+        }
+
+        if (m_end - m_cur < 2)
+            return false;
+        char e = m_cur[1];
+        m_cur += 2;
+        switch (e)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            *dst++ = e;
+            break;
+        case 'b':
+            *dst++ = '\b';
+            break;
+        case 'f':
+            *dst++ = '\f';
+            break;
+        case 'n':
+            *dst++ = '\n';
+            break;
+        case 'r':
+            *dst++ = '\r';
+            break;
+        case 't':
+            *dst++ = '\t';
+            break;
+        case 'u':
+        {
+            uint32_t code;
+            if (m_end - m_cur < 4 || !read_hex4(m_cur, code))
+                return false;
+            m_cur += 4;
+            //UTF-16代理对
+            if (code >= 0xD800 && code <= 0xDBFF)
+            {
+                uint32_t low;
+                if (m_end - m_cur < 6 || m_cur[0] != '\\' || m_cur[1] != 'u' ||
+                    !read_hex4(m_cur + 2, low) || low < 0xDC00 || low > 0xDFFF)
+                    return false;
+                m_cur += 6;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (code >= 0xDC00 && code <= 0xDFFF)
+                return false;
+            dst += put_utf8(dst, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
+bool json_parser::parse_number()
+{
+    char *p = m_cur;
+    if (p < m_end && *p == '-')
+        ++p;
+    if (p >= m_end)
+        return false;
+    if (*p == '0')
+        ++p;
+    else if (*p >= '1' && *p <= '9')
+        while (p < m_end && *p >= '0' && *p <= '9')
+            ++p;
+    else
+        return false;
+
+    if (p < m_end && *p == '.')
+    {
+        ++p;
+        char *digits = p;
+        while (p < m_end && *p >= '0' && *p <= '9')
+            ++p;
+        if (p == digits)
+            return false;
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        if (p < m_end && (*p == '+' || *p == '-'))
+            ++p;
+        char *digits = p;
+        while (p < m_end && *p >= '0' && *p <= '9')
+            ++p;
+        if (p == digits)
+            return false;
+    }
+    m_cur = p;
+    return true;
+}
+
+bool json_parser::parse_literal(const char *word, size_t len)
+{
+    if ((size_t)(m_end - m_cur) < len || memcmp(m_cur, word, len) != 0)
+        return false;
+    m_cur += len;
+    return true;
+}
+
+//校验并跳过嵌套的对象或数组，m_cur指向起始括号
+bool json_parser::parse_container(char close, int depth)
+{
+    if (depth > MAX_DEPTH)
+        return false;
+    ++m_cur;
+    skip_space();
+    if (m_cur < m_end && *m_cur == close)
+    {
+        ++m_cur;
+        return true;
+    }
+    while (true)
+    {
+        json_value value;
+        if (close == '}')
+        {
+            std::string_view key;
+            skip_space();
+            if (m_cur >= m_end || *m_cur != '"' || !parse_string(key))
+                return false;
+            skip_space();
+            if (m_cur >= m_end || *m_cur != ':')
+                return false;
+            ++m_cur;
+        }
+        if (!parse_value(value, depth))
+            return false;
+        skip_space();
+        if (m_cur >= m_end)
+            return false;
+        if (*m_cur == close)
+        {
+            ++m_cur;
+            return true;
+        }
+        if (*m_cur != ',')
+            return false;
+        ++m_cur;
+    }
+}
+
+//  --------------json_writer---------------------
+void json_writer::put(const char *data, size_t len)
+{
+    if (!m_ok || m_len + len > m_cap)
+    {
+        m_ok = false;
+        return;
+    }
+    memcpy(m_buf + m_len, data, len);
+    m_len += len;
+}
+
+void json_writer::separator()
+{
+    if (!m_first)
+        put(',');
+    m_first = false;
+}
+
+json_writer &json_writer::begin_object()
+{
+    put('{');
+    m_first = true;
+    return *this;
+}
+
+json_writer &json_writer::end_object()
+{
+    put('}');
+    m_first = false;
+    return *this;
+}
+
+json_writer &json_writer::key(std::string_view name)
+{
+    separator();
+    string(name);
+    put(':');
+    return *this;
+}
+
+//输出带引号的字符串，需要转义的字符之间的普通字符整段拷贝
+json_writer &json_writer::string(std::string_view value)
+{
+    static const char hex[] = "0123456789abcdef";
+    put('"');
+    const char *p = value.data();
+    const char *end = p + value.size();
+    const char *run = p;
+    while (p < end)
+    {
+        while (end - p >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            if (has_special(word))
+                break;
+            p += 8;
+        }
+        if (p >= end)
+            break;
+        unsigned char c = *p;
+        if (c != '"' && c != '\\' && c >= 0x20)
+        {
+            ++p;
+            continue;
+        }
+        put(run, p - run);
+        if (c == '"' || c == '\\')
+        {
+            char esc[2] = {'\\', (char)c};
+            put(esc, 2);
+        }
+        else
+        {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+            put(esc, 6);
+        }
+        run = ++p;
+    }
+    put(run, end - run);
+    put('"');
+    return *this;
+}
+
+json_writer &json_writer::boolean(bool value)
+{
+    if (value)
+        put("true", 4);
+    else
+        put("false", 5);
+    return *this;
+}
+
+json_writer &json_writer::number(long long value)
+{
+    char digits[24];
+    std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+    put(digits, r.ptr - digits);
+    return *this;
+}
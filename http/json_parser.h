@@ -0,0 +1,93 @@
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+// 原地JSON解析器
+// 只索引顶层对象的字段，嵌套的对象和数组只做校验并以原始文本返回
+// 字符串在读缓冲区上就地反转义，整个过程没有堆分配
+enum JSON_TYPE
+{
+    JSON_NULL = 0,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_OBJECT,
+    JSON_ARRAY
+};
+
+struct json_value
+{
+    JSON_TYPE type;
+    std::string_view text;  //字符串为反转义后的内容，其余类型为原始文本
+};
+
+class json_parser
+{
+public:
+    static const int MAX_FIELDS = 16;   //顶层对象最多保存的字段数
+    static const int MAX_DEPTH = 32;    //最大嵌套深度
+
+    json_parser() : m_count(0) {}
+
+    //解析data开始的len个字节，顶层必须是对象
+    bool parse(char *data, size_t len);
+
+    bool get(std::string_view key, json_value &value) const;
+    //仅当字段存在且为字符串时返回true
+    bool get_string(std::string_view key, std::string_view &value) const;
+
+    int size() const { return m_count; }
+
+private:
+    struct field
+    {
+        std::string_view key;
+        json_value value;
+    };
+
+    void skip_space();
+    bool parse_value(json_value &value, int depth);
+    bool parse_string(std::string_view &out);
+    bool parse_number();
+    bool parse_literal(const char *word, size_t len);
+    bool parse_container(char close, int depth);
+
+    char *m_cur;
+    char *m_end;
+    field m_fields[MAX_FIELDS];
+    int m_count;
+};
+
+// JSON应答生成器，直接写入调用者提供的定长缓冲区，不经过printf族函数
+// 任一步空间不足后ok()返回false
+class json_writer
+{
+public:
+    json_writer(char *buf, size_t cap) : m_buf(buf), m_cap(cap), m_len(0), m_ok(true), m_first(true) {}
+
+    json_writer &begin_object();
+    json_writer &end_object();
+    json_writer &key(std::string_view name);
+    json_writer &string(std::string_view value);
+    json_writer &boolean(bool value);
+    json_writer &number(long long value);
+
+    bool ok() const { return m_ok; }
+    size_t size() const { return m_len; }
+
+private:
+    void put(const char *data, size_t len);
+    void put(char c) { put(&c, 1); }
+    void separator();
+
+    char *m_buf;
+    size_t m_cap;
+    size_t m_len;
+    bool m_ok;
+    bool m_first;   //当前对象中是否还没有写入任何字段
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+#include <stddef.h>
+#include <string_view>
+
+// 扩展名到MIME类型的映射表
+// 表在编译期按扩展名排好序并由static_assert校验，运行时只做一次二分查找，没有任何堆分配
+
+struct mime_type
+{
+    std::string_view ext;       //小写扩展名，不含点
+    std::string_view type;      //Content-Type的值
+    bool compressible;          //是否为值得压缩的文本类型
+};
+
+//必须按ext的字典序排列
+constexpr mime_type MIME_TABLE[] = {
+    {"avif", "image/avif", false},
+    {"bmp", "image/bmp", false},
+    {"css", "text/css; charset=utf-8", true},
+    {"gif", "image/gif", false},
+    {"htm", "text/html; charset=utf-8", true},
+    {"html", "text/html; charset=utf-8", true},
+    {"ico", "image/x-icon", true},
+    {"jpeg", "image/jpeg", false},
+    {"jpg", "image/jpeg", false},
+    {"js", "text/javascript; charset=utf-8", true},
+    {"json", "application/json", true},
+    {"mjs", "text/javascript; charset=utf-8", true},
+    {"mp3", "audio/mpeg", false},
+    {"mp4", "video/mp4", false},
+    {"ogg", "audio/ogg", false},
+    {"otf", "font/otf", false},
+    {"pdf", "application/pdf", false},
+    {"png", "image/png", false},
+    {"svg", "image/svg+xml", true},
+    {"ttf", "font/ttf", true},
+    {"txt", "text/plain; charset=utf-8", true},
+    {"wasm", "application/wasm", true},
+    {"wav", "audio/wav", false},
+    {"webm", "video/webm", false},
+    {"webp", "image/webp", false},
+    {"woff", "font/woff", false},
+    {"woff2", "font/woff2", false},
+    {"xml", "application/xml", true},
+};
+
+//未登记的扩展名
+constexpr mime_type MIME_DEFAULT = {"", "application/octet-stream", false};
+
+constexpr size_t MIME_COUNT = sizeof(MIME_TABLE) / sizeof(MIME_TABLE[0]);
+
+constexpr bool mime_table_sorted()
+{
+    for (size_t i = 1; i < MIME_COUNT; ++i)
+        if (!(MIME_TABLE[i - 1].ext < MIME_TABLE[i].ext))
+            return false;
+    return true;
+}
+static_assert(mime_table_sorted(), "MIME_TABLE must be sorted by extension");
+
+//按文件路径的扩展名查找，大小写不敏感
+inline const mime_type &mime_lookup(std::string_view path)
+{
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash))
+        return MIME_DEFAULT;
+
+    //转成小写，超过表中最长扩展名的不可能命中
+    char buf[8];
+    std::string_view ext = path.substr(dot + 1);
+    if (ext.empty() || ext.size() > sizeof(buf))
+        return MIME_DEFAULT;
+    for (size_t i = 0; i < ext.size(); ++i)
+        buf[i] = (ext[i] >= 'A' && ext[i] <= 'Z') ? ext[i] - 'A' + 'a' : ext[i];
+    ext = std::string_view(buf, ext.size());
+
+    size_t lo = 0, hi = MIME_COUNT;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (MIME_TABLE[mid].ext < ext)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < MIME_COUNT && MIME_TABLE[lo].ext == ext)
+        return MIME_TABLE[lo];
+    return MIME_DEFAULT;
+}
+
+#endif
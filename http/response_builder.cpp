@@ -0,0 +1,56 @@
+#include "response_builder.h"
+#include <stdlib.h>
+#include <charconv>
+
+response_builder::~response_builder()
+{
+    if (m_buf != m_inline)
+        free(m_buf);
+}
+
+void response_builder::clear()
+{
+    if (m_buf != m_inline)
+    {
+        free(m_buf);
+        m_buf = m_inline;
+        m_cap = INLINE_SIZE;
+    }
+    m_len = 0;
+    m_ok = true;
+}
+
+response_builder &response_builder::header(std::string_view name, long long value)
+{
+    char digits[24];
+    std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value);
+    return header(name, std::string_view(digits, r.ptr - digits));
+}
+
+//保证还能再写入need个字节，容量按倍数增长
+bool response_builder::grow(size_t need)
+{
+    if (!m_ok)
+        return false;
+    size_t cap = m_cap;
+    while (cap < m_len + need)
+        cap *= 2;
+
+    char *buf;
+    if (m_buf == m_inline)
+    {
+        buf = (char *)malloc(cap);
+        if (buf)
+            memcpy(buf, m_inline, m_len);
+    }
+    else
+        buf = (char *)realloc(m_buf, cap);
+    if (!buf)
+    {
+        m_ok = false;
+        return false;
+    }
+    m_buf = buf;
+    m_cap = cap;
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef RESPONSE_BUILDER_H
+#define RESPONSE_BUILDER_H
+
+#include <stddef.h>
+#include <string.h>
+#include <string_view>
+
+// 应答头部生成器
+// 状态行与头部名称都是编译期常量，按已知长度直接memcpy，整数用std::to_chars格式化，不经过printf族函数
+// 头部先写入对象内的缓冲区，放不下时才转到堆上按倍数扩容，头部的数量和长度没有固定上限
+
+//常用头部名称
+constexpr std::string_view HEADER_CONTENT_LENGTH = "Content-Length";
+constexpr std::string_view HEADER_CONTENT_TYPE = "Content-Type";
+constexpr std::string_view HEADER_CONTENT_ENCODING = "Content-Encoding";
+constexpr std::string_view HEADER_CONNECTION = "Connection";
+constexpr std::string_view HEADER_VARY = "Vary";
+constexpr std::string_view HEADER_DATE = "Date";
+constexpr std::string_view HEADER_ETAG = "ETag";
+constexpr std::string_view HEADER_LAST_MODIFIED = "Last-Modified";
+constexpr std::string_view HEADER_CACHE_CONTROL = "Cache-Control";
+constexpr std::string_view HEADER_ACCEPT_RANGES = "Accept-Ranges";
+constexpr std::string_view HEADER_CONTENT_RANGE = "Content-Range";
+
+//状态码对应的完整状态行，未登记的状态码按500处理
+constexpr std::string_view status_line(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "HTTP/1.1 200 OK\r\n";
+    case 206:
+        return "HTTP/1.1 206 Partial Content\r\n";
+    case 304:
+        return "HTTP/1.1 304 Not Modified\r\n";
+    case 400:
+        return "HTTP/1.1 400 Bad Request\r\n";
+    case 401:
+        return "HTTP/1.1 401 Unauthorized\r\n";
+    case 403:
+        return "HTTP/1.1 403 Forbidden\r\n";
+    case 404:
+        return "HTTP/1.1 404 Not Found\r\n";
+    case 409:
+        return "HTTP/1.1 409 Conflict\r\n";
+    case 413:
+        return "HTTP/1.1 413 Payload Too Large\r\n";
+    case 416:
+        return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    case 431:
+        return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+    default:
+        return "HTTP/1.1 500 Internal Error\r\n";
+    }
+}
+
+class response_builder
+{
+public:
+    static const size_t INLINE_SIZE = 1024;     //对象内缓冲区大小，常见应答头部都放得下
+
+    response_builder() : m_buf(m_inline), m_len(0), m_cap(INLINE_SIZE), m_ok(true) {}
+    ~response_builder();
+    response_builder(const response_builder &) = delete;
+    response_builder &operator=(const response_builder &) = delete;
+
+    //清空内容，扩容过的堆缓冲区同时归还，避免长连接一直占用
+    void clear();
+
+    response_builder &status(int code) { return append(status_line(code)); }
+    //写入"name: value\r\n"
+    response_builder &header(std::string_view name, std::string_view value)
+    {
+        size_t need = name.size() + value.size() + 4;
+        if (m_len + need > m_cap && !grow(need))
+            return *this;
+        char *p = m_buf + m_len;
+        memcpy(p, name.data(), name.size());
+        p += name.size();
+        memcpy(p, ": ", 2);
+        p += 2;
+        memcpy(p, value.data(), value.size());
+        p += value.size();
+        memcpy(p, "\r\n", 2);
+        m_len += need;
+        return *this;
+    }
+    response_builder &header(std::string_view name, long long value);
+    //头部结束的空行
+    response_builder &end_headers() { return append("\r\n"); }
+    response_builder &append(std::string_view data)
+    {
+        if (m_len + data.size() > m_cap && !grow(data.size()))
+            return *this;
+        memcpy(m_buf + m_len, data.data(), data.size());
+        m_len += data.size();
+        return *this;
+    }
+
+    //任一步扩容失败后返回false，之后的写入都被忽略
+    bool ok() const { return m_ok; }
+    const char *data() const { return m_buf; }
+    size_t size() const { return m_len; }
+
+private:
+    bool grow(size_t need);
+
+    char *m_buf;
+    size_t m_len;
+    size_t m_cap;
+    bool m_ok;
+    char m_inline[INLINE_SIZE];
+};
+
+#endif
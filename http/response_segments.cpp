@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include "response_segments.h"
+
+void response_segments::push(SEGMENT_TYPE type, const char *data, file_entry *entry, off_t offset, size_t len, char *owned)
+{
+    if (len == 0)
+    {
+        free(owned);
+        return;
+    }
+    if (entry)
+        file_cache::get_instance()->retain(entry);
+    //连接复用时保留容量，稳定后不再分配
+    if (m_segments.capacity() == 0)
+        m_segments.reserve(8);
+    segment s = {type, data, entry, offset, len, owned};
+    m_segments.push_back(s);
+    m_bytes += len;
+}
+
+void response_segments::add(const char *data, size_t len)
+{
+    push(SEG_MEMORY, data, NULL, 0, len, NULL);
+}
+
+void response_segments::add_owned(char *data, size_t len)
+{
+    push(SEG_MEMORY, data, NULL, 0, len, data);
+}
+
+void response_segments::add_shared(file_entry *entry, const char *data, size_t len)
+{
+    push(SEG_MEMORY, data, entry, 0, len, NULL);
+}
+
+void response_segments::add_file(file_entry *entry, off_t offset, size_t len)
+{
+    push(SEG_FILE, NULL, entry, offset, len, NULL);
+}
+
+const response_segments::segment *response_segments::first_entry() const
+{
+    for (size_t i = m_pos; i < m_segments.size(); ++i)
+    {
+        if (m_segments[i].entry)
+            return &m_segments[i];
+    }
+    return NULL;
+}
+
+int response_segments::gather(struct iovec *iov, int max, size_t alone) const
+{
+    int n = 0;
+    for (size_t i = m_pos; i < m_segments.size() && n < max; ++i)
+    {
+        const segment &s = m_segments[i];
+        if (s.type != SEG_MEMORY)
+            break;
+        bool big = alone && s.entry && s.len >= alone;
+        if (big && n > 0)
+            break;
+        iov[n].iov_base = (void *)s.data;
+        iov[n].iov_len = s.len;
+        ++n;
+        if (big)
+            break;
+    }
+    return n;
+}
+
+void response_segments::consume(size_t n)
+{
+    m_bytes -= n;
+    while (n > 0 && m_pos < m_segments.size())
+    {
+        segment &s = m_segments[m_pos];
+        if (n < s.len)
+        {
+            //停在这一段的中间
+            s.len -= n;
+            if (s.type == SEG_MEMORY)
+                s.data += n;
+            else
+                s.offset += n;
+            return;
+        }
+        n -= s.len;
+        s.len = 0;
+        ++m_pos;
+    }
+}
+
+void response_segments::clear()
+{
+    for (size_t i = 0; i < m_segments.size(); ++i)
+    {
+        segment &s = m_segments[i];
+        free(s.owned);
+        if (s.entry)
+            file_cache::get_instance()->release(s.entry);
+    }
+    m_segments.clear();
+    m_pos = 0;
+    m_bytes = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef RESPONSE_SEGMENTS_H
+#define RESPONSE_SEGMENTS_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <stddef.h>
+#include <vector>
+#include "../cache/file_cache.h"
+
+// 由若干段按顺序组成的应答
+// 内存段(头部、模板片段、缓存中的文件映射或完整应答)聚集成iovec一次sendmsg发出，文件段由调用者用sendfile或分段映射发送
+// 部分写入后用consume前移，可能停在任意一段的中间，下次从停下的位置继续
+// 段引用的文件条目在加入时增加引用，clear时统一释放，因此发送过程中段指向的内存一直有效
+class response_segments
+{
+public:
+    static const int MAX_BATCH = IOV_MAX < 64 ? IOV_MAX : 64;     //一次sendmsg最多聚集的段数
+
+    enum SEGMENT_TYPE
+    {
+        SEG_MEMORY = 0,
+        SEG_FILE
+    };
+    struct segment
+    {
+        SEGMENT_TYPE type;
+        const char *data;       //内存段的起始位置，随部分写入前移
+        file_entry *entry;      //文件段所在的文件，或共享内存段所属的缓存条目，持有引用；借用的内存为NULL
+        off_t offset;           //文件段在文件中的偏移，随部分写入前移
+        size_t len;             //剩余字节数
+        char *owned;            //由本对象释放的malloc内存，即data的初始值，借用或共享的内存为NULL
+    };
+
+    response_segments() : m_pos(0), m_bytes(0) {}
+    ~response_segments() { clear(); }
+
+    //借用的内存，发送完之前调用者保证其有效，如m_response中的头部和常量模板片段
+    void add(const char *data, size_t len);
+    //malloc分配的内存，交由本对象释放
+    void add_owned(char *data, size_t len);
+    //缓存条目中的一段内存，如文件的整体映射或预先生成的完整应答
+    void add_shared(file_entry *entry, const char *data, size_t len);
+    //文件中的一段，不经过用户态内存发送
+    void add_file(file_entry *entry, off_t offset, size_t len);
+
+    bool empty() const { return m_pos == m_segments.size(); }
+    //剩余段数与剩余字节数
+    size_t count() const { return m_segments.size() - m_pos; }
+    long long bytes() const { return m_bytes; }
+    //当前发送到的段
+    const segment &front() const { return m_segments[m_pos]; }
+    //从当前段起第一个引用缓存条目的段，跳过借用和自有的内存，没有时返回NULL
+    const segment *first_entry() const;
+
+    //从当前段起把连续的内存段填入iov，遇到文件段为止，返回填入的个数
+    //alone不为0时，长度不小于alone的共享段单独成批，供调用者零拷贝发送
+    int gather(struct iovec *iov, int max, size_t alone = 0) const;
+    //已发送n字节，前移到下一个未发送的位置
+    void consume(size_t n);
+    //释放所有段持有的资源，回到空应答
+    void clear();
+
+private:
+    void push(SEGMENT_TYPE type, const char *data, file_entry *entry, off_t offset, size_t len, char *owned);
+
+    std::vector<segment> m_segments;
+    size_t m_pos;           //第一个未发送完的段
+    long long m_bytes;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+// 编译期路由表
+// 精确路由在编译期构造完美哈希（搜索一个无冲突的种子），运行时一次哈希加一次比较即可命中
+// 前缀路由数量很少，按最长前缀线性匹配；整个查找过程没有任何堆分配
+
+//路由匹配方式
+enum ROUTE_MATCH
+{
+    MATCH_EXACT = 0,
+    MATCH_PREFIX
+};
+
+//请求方法掩码，位序与http_conn::METHOD一致
+const unsigned ROUTE_GET = 1u << 0;
+const unsigned ROUTE_POST = 1u << 1;
+const unsigned ROUTE_HEAD = 1u << 2;
+const unsigned ROUTE_ANY = ~0u;
+
+template <typename Handler>
+struct route
+{
+    unsigned methods = 0;       //允许的请求方法
+    ROUTE_MATCH match = MATCH_EXACT;
+    std::string_view path;
+    Handler handler = nullptr;
+    const char *target = nullptr;   //交给处理函数的参数，如页面对应的文件
+};
+
+constexpr uint32_t route_hash(std::string_view s, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+template <typename Handler, size_t N>
+class route_table
+{
+public:
+    //哈希槽数取不小于4N的2的幂，保证种子搜索很快结束
+    static constexpr size_t slot_count()
+    {
+        size_t n = 1;
+        while (n < 4 * N)
+            n <<= 1;
+        return n;
+    }
+    static const size_t SLOTS = slot_count();
+    static const uint32_t MAX_SEED = 1 << 16;
+    static_assert(N < 255, "route index must fit in uint8_t");
+
+    constexpr route_table(const route<Handler> (&routes)[N]) : m_routes(), m_slots(), m_seed(0)
+    {
+        for (size_t i = 0; i < N; ++i)
+            m_routes[i] = routes[i];
+        while (m_seed < MAX_SEED && !try_seed(m_seed))
+            ++m_seed;
+    }
+
+    //为false说明精确路由存在重复路径
+    constexpr bool perfect() const { return m_seed < MAX_SEED; }
+
+    //查找与method和path匹配的路由，优先精确匹配，其次最长前缀，找不到返回NULL
+    const route<Handler> *match(int method, std::string_view path) const
+    {
+        unsigned bit = 1u << method;
+        uint8_t idx = m_slots[route_hash(path, m_seed) & (SLOTS - 1)];
+        if (idx && m_routes[idx - 1].path == path && (m_routes[idx - 1].methods & bit))
+            return &m_routes[idx - 1];
+
+        const route<Handler> *best = nullptr;
+        for (size_t i = 0; i < N; ++i)
+        {
+            const route<Handler> &r = m_routes[i];
+            if (r.match == MATCH_PREFIX && (r.methods & bit) &&
+                path.substr(0, r.path.size()) == r.path &&
+                (!best || r.path.size() > best->path.size()))
+                best = &r;
+        }
+        return best;
+    }
+
+private:
+    constexpr bool try_seed(uint32_t seed)
+    {
+        for (size_t i = 0; i < SLOTS; ++i)
+            m_slots[i] = 0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            if (m_routes[i].match != MATCH_EXACT)
+                continue;
+            size_t slot = route_hash(m_routes[i].path, seed) & (SLOTS - 1);
+            if (m_slots[slot])
+                return false;
+            m_slots[slot] = (uint8_t)(i + 1);
+        }
+        return true;
+    }
+
+    route<Handler> m_routes[N];
+    uint8_t m_slots[SLOTS];     //存放路由下标+1，0表示空槽
+    uint32_t m_seed;
+};
+
+template <typename Handler, size_t N>
+constexpr route_table<Handler, N> make_route_table(const route<Handler> (&routes)[N])
+{
+    return route_table<Handler, N>(routes);
+}
+
+#endif
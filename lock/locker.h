@@ -4,6 +4,11 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <unistd.h>
+#include <limits.h>
+#include <atomic>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 // 信号量类
 class sem
@@ -94,5 +99,68 @@ private:
     pthread_cond_t m_cond;
 };
 
+// 自旋等待时提示CPU，降低功耗并让出超线程的执行资源
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// 事件计数，让等待无锁队列的线程在futex上休眠
+// 等待方：key = prepare_wait()，再检查一次条件，条件已满足则cancel_wait()，否则wait(key)
+// 通知方：先使条件成立(如入队)，再notify_one()；没有等待者时只是一次原子读，不进入内核，返回false
+// prepare_wait之后发生的通知都会改变计数，wait发现计数已变立即返回，不会丢失唤醒
+class event_count
+{
+public:
+    event_count() : m_epoch(0), m_waiters(0) {}
+
+    int prepare_wait()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        int key = m_epoch.load(std::memory_order_seq_cst);
+        //之后对条件的检查不能提前到登记等待之前
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return key;
+    }
+    void cancel_wait()
+    {
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void wait(int key)
+    {
+        //被信号打断或计数已变时返回，由调用者重新检查条件
+        syscall(SYS_futex, (int *)&m_epoch, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+    bool notify_one()
+    {
+        return notify(1);
+    }
+    bool notify_all()
+    {
+        return notify(INT_MAX);
+    }
+
+private:
+    bool notify(int count)
+    {
+        //与等待方的prepare_wait构成先写后读的配对，两边至少有一方看到对方的修改
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return false;
+        m_epoch.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, (int *)&m_epoch, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+        return true;
+    }
+
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs a plain int");
+    std::atomic<int> m_epoch;
+    std::atomic<int> m_waiters;
+};
+
 
 #endif
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <sys/time.h>
 #include <stdarg.h>
 #include "log.h"
+#include "../timer/coarse_clock.h"
 #include <pthread.h>
 using namespace std;
 
@@ -75,11 +76,10 @@ bool Log::init(const char *file_name, int close_log, int log_buf_size, int split
 
 void Log::write_log(int level, const char *format, ...)
 {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, NULL);
-    time_t t = now.tv_sec;
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    //时间戳取自主线程每轮更新的时钟，已按秒格式化好
+    struct tm my_tm;
+    char stamp[coarse_clock::LOG_TIME_LEN];
+    coarse_clock::get_instance()->log_time(stamp, &my_tm);
     char s[16] = {0};
     switch (level)
     {
@@ -136,11 +136,14 @@ void Log::write_log(int level, const char *format, ...)
     string log_str;
     m_mutex.lock();
 
-    //写入内容格式：时间 + 内容
-    //时间格式化，snprintf成功返回写字符的总数，其中不包括结尾的null字符
-    int n = snprintf(m_buf, 48, "%d-%02d-%02d %02d:%02d:%02d.%06ld %s ",
-                     my_tm.tm_year + 1900, my_tm.tm_mon + 1, my_tm.tm_mday,
-                     my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
+    //写入内容格式：时间 + 级别 + 内容
+    int n = coarse_clock::LOG_TIME_LEN;
+    memcpy(m_buf, stamp, n);
+    m_buf[n++] = ' ';
+    size_t level_len = strlen(s);
+    memcpy(m_buf + n, s, level_len);
+    n += level_len;
+    m_buf[n++] = ' ';
     //内容格式化，用于向字符串中打印数据、数据格式用户自定义，返回写入到字符数组str中的字符个数(不包含终止符)
     int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
     m_buf[n + m] = '\n';
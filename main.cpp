@@ -16,7 +16,11 @@ int main(int argc,char *argv[])
     //初始化
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode, config.sql_num, config.thread_num,
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.upload_threshold,
+                config.cache_size, config.send_mode, config.prerender_size,
+                config.cache_rules, config.io_threads, config.bundle_path,
+                config.zerocopy_size, config.sched_mode, config.max_thread_num,
+                config.limits);
     
     //初始化日志
     server.log_write();
@@ -24,6 +28,9 @@ int main(int argc,char *argv[])
     //数据库
     server.sql_pool();
 
+    //静态文件缓存
+    server.cache_pool();
+
     //线程池
     server.thread_pool();
 
@@ -0,0 +1,111 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// 有界多生产者多消费者无锁队列(Vyukov)
+// 每个槽带一个序号：序号等于入队位置时槽为空可写，等于位置+1时已写入可读，读完置为位置+容量留给下一圈
+// 生产者和消费者各自用CAS抢占位置，抢到后只读写自己的槽，入队出队都不分配内存
+// 入队位置、出队位置和每个槽各占一个缓存行，避免生产者与消费者互相使对方的缓存行失效
+template <typename T>
+class mpmc_queue
+{
+public:
+    static const size_t CACHE_LINE = 64;
+
+    //容量向上取整为2的幂
+    explicit mpmc_queue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_cells = new cell[size];
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_enqueue_pos.store(0, std::memory_order_relaxed);
+        m_dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+    ~mpmc_queue() { delete[] m_cells; }
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    size_t capacity() const { return m_mask + 1; }
+
+    //队列满时返回false
+    bool push(const T &value)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        cell *c;
+        while (true)
+        {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            //槽还没有被上一圈的消费者读走，队列已满
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+        c->data = value;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    //队列空时返回false
+    bool pop(T &value)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        cell *c;
+        while (true)
+        {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            //槽还没有写入，队列为空
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+        value = c->data;
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    //近似的元素个数，并发修改时只作参考
+    size_t size_approx() const
+    {
+        size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+        size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct alignas(CACHE_LINE) cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    alignas(CACHE_LINE) cell *m_cells;
+    size_t m_mask;
+    alignas(CACHE_LINE) std::atomic<size_t> m_enqueue_pos;
+    alignas(CACHE_LINE) std::atomic<size_t> m_dequeue_pos;
+    char m_pad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
@@ -1,25 +1,45 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
-#include <list>
 #include <cstdio>
+#include <stdint.h>
 #include <exception>
+#include <atomic>
+#include <climits>
 #include <pthread.h>
 #include "../lock/locker.h"
-#include "../CGImysql/sql_connection_pool.h"
+#include "../timer/coarse_clock.h"
+#include "mpmc_queue.h"
+#include "ws_deque.h"
+
+// 任务的分派方式
+enum SCHED_MODE
+{
+    SCHED_SHARED = 0,       //所有线程共用一个请求队列
+    SCHED_AFFINITY,         //每个线程有自己的队列，同一连接的请求放入同一个线程，空闲线程窃取
+    SCHED_ROUND_ROBIN       //每个线程有自己的队列，请求轮流放入，空闲线程窃取
+};
 
 // 线程池类，将它定义为模板类是为了代码复用，模板参数T是任务类
+// 共用队列模式下线程数可以在[thread_number, max_threads]之间伸缩：
+// 所有线程都在处理任务、队列中的任务等待超过SOJOURN_TARGET_MS时按积压的任务数增加线程，
+// 一个RETIRE_WINDOW_MS窗口内始终空闲的线程数即为多余的线程，窗口结束时让它们退出
 template <typename T>
 class threadpool
 {
 public:
+    static const int SOJOURN_TARGET_MS = 10;    //任务在队列中等待超过该毫秒数时扩容
+    static const int GROW_INTERVAL_MS = 10;     //两次扩容的最小间隔
+    static const int RETIRE_WINDOW_MS = 30000;  //统计空闲线程的窗口
 
     /* 构造函数
        actor_model:工作模式
-       connPool:数据库连接池指针
-       thread_number:线程池中线程的数量
-       max_requests:请求队列中最多允许的、等待处理的请求的数量 */
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_requests = 10000);
+       thread_number:线程池中线程的数量，伸缩时为下限
+       max_requests:请求队列中最多允许的、等待处理的请求的数量，向上取整为2的幂
+       sched_mode:任务的分派方式，见SCHED_MODE
+       max_threads:线程数上限，不大于thread_number时线程数固定；工作窃取模式下线程数总是固定 */
+    threadpool(int actor_model, int thread_number = 8, int max_requests = 10000,
+               int sched_mode = SCHED_SHARED, int max_threads = 0);
     
      // 析构函数
     ~threadpool();
@@ -27,93 +47,236 @@ public:
     // 向请求队列中添加任务
     bool append(T *request, int state);
     bool append_p(T *request);
+    // 根据排队时间和空闲线程数增减线程，由主线程在入队后和每次定时调用
+    void balance();
 
 private:
     /*工作线程运行的函数，它不断从工作队列中取出任务并执行之*/
     static void *worker(void *arg);
     void run();     // 工作队列任务处理函数
+    T *take();      // 取出一个任务，队列为空时休眠，线程应退出时返回NULL
+    struct task;
+    T *taken(const task &t);
+    bool spawn();   // 创建一个脱离线程
+    bool retire();  // 领取一个退出名额
+    // 工作窃取模式
+    bool dispatch(T *request);
+    void wake(int index);
+    T *find_task(int index);
+    T *take_local(int index);
 
 private:
-    int m_thread_number;        //线程池中的线程数
+    // 请求队列中的任务，带上入队时间用于计算排队时间
+    struct task
+    {
+        T *request;
+        long long enqueued;
+    };
+
+    // 工作窃取模式下每个线程的队列
+    // 生产者只能放入inbox；所属线程从inbox取出一小批放入deque，其他线程从deque顶部或inbox窃取
+    struct worker_slot
+    {
+        static const int BATCH = 4;     //一次从inbox转入deque的任务数
+
+        explicit worker_slot(size_t capacity) : inbox(capacity), deque(BATCH * 2), held(NULL) {}
+
+        mpmc_queue<T *> inbox;
+        ws_deque<T *> deque;
+        event_count idle;       //所属线程在此休眠，有任务放入时优先唤醒它
+        T *held;                //放不回inbox的任务，由所属线程下一次直接处理
+    };
+
+    int m_thread_number;        //线程池中的线程数，伸缩时为下限
+    int m_max_threads;          //线程数上限
     int m_max_requests;         //请求队列中允许的最大请求数
-    pthread_t *m_threads;       //描述线程池的数组，其大小为m_thread_number
-    std::list<T *> m_workqueue;  //请求队列
-    locker m_queuelocker;       //保护请求队列的互斥锁
-    sem m_queuestat;            //请求队列中是否有任务需要处理
-    connection_pool *m_connPool;  //数据库
+    mpmc_queue<task> m_workqueue;   //请求队列，无锁的环形缓冲区
+    event_count m_queuestat;    //请求队列为空时工作线程在此休眠
     int m_actor_model;          //模型切换
+    int m_sched_mode;           //任务的分派方式
+    worker_slot **m_slots;      //工作窃取模式下各线程的队列
+    std::atomic<int> m_next_index;  //分配给新线程的下标
+    unsigned m_next_target;     //轮流分派的下一个线程，只有主线程分派任务
+    // 伸缩的统计，工作线程只在伸缩开启时更新
+    std::atomic<int> m_live;            //存活的线程数
+    std::atomic<int> m_busy;            //正在处理任务的线程数
+    std::atomic<int> m_retire;          //待领取的退出名额
+    std::atomic<int> m_sojourn_ms;      //最近一个任务的排队时间
+    std::atomic<long long> m_last_pop_ms;   //最近一次取出任务的时间
+    // 以下只由主线程读写
+    long long m_last_grow_ms;           //上次扩容的时间
+    long long m_window_start_ms;        //当前空闲统计窗口的起点
+    int m_idle_low;                     //窗口内观察到的最少空闲线程数
 };
 template <typename T>
-threadpool<T>::threadpool( int actor_model, connection_pool *connPool, int thread_number, int max_requests) :
+threadpool<T>::threadpool( int actor_model, int thread_number, int max_requests, int sched_mode,
+                           int max_threads) :
         m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests),
-        m_threads(NULL), m_connPool(connPool)
+        m_workqueue(sched_mode == SCHED_SHARED && max_requests > 0 ? max_requests : 1),
+        m_sched_mode(sched_mode), m_slots(NULL), m_next_index(0), m_next_target(0),
+        m_live(0), m_busy(0), m_retire(0), m_sojourn_ms(0), m_last_pop_ms(0),
+        m_last_grow_ms(0), m_idle_low(INT_MAX)
 {
     // 线程数和允许的最大请求数均小等于0，出错
     if (thread_number <= 0 || max_requests <= 0)
     { 
         throw std::exception();
     }
-    // 初始化线程，分配id
-    m_threads = new pthread_t[m_thread_number];
-    if (!m_threads)
-        throw std::exception();
-    // 创建thread_number 个线程，并将他们设置为脱离线程。
+    // 工作窃取模式下每个线程有固定的队列，不伸缩
+    m_max_threads = m_sched_mode == SCHED_SHARED && max_threads > thread_number ? max_threads : thread_number;
+    m_window_start_ms = coarse_clock::get_instance()->now_ms();
+    // 工作窃取模式下请求总数的上限平分给各线程
+    if (m_sched_mode != SCHED_SHARED)
+    {
+        m_slots = new worker_slot *[m_thread_number];
+        for (int i = 0; i < m_thread_number; ++i)
+            m_slots[i] = new worker_slot((max_requests + m_thread_number - 1) / m_thread_number);
+    }
+    // 创建thread_number 个线程
     for (int i = 0; i < thread_number; i++)
     {
-        // 循环创建线程，1标识符，2线程属性（NULL为默认），3指定线程将运行的函数，4运行的参数
-        // 函数原型中的第三个参数，为函数指针，指向处理线程函数的地址。
-        // 该函数，要求为静态函数。如果处理线程函数为类成员函数时，需要将其设置为静态成员函数。
-        // 但静态成员函数不能访问非静态成员变量，所以通过this传递到arg中，再通过它去访问成员变量
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0)
-        {
-            delete []m_threads;
+        if (!spawn())
             throw std::exception();
-        }
-        if (pthread_detach(m_threads[i])){
-            delete []m_threads;
-            throw std::exception();
-        }
     }
     
 }
 template <typename T>
 threadpool<T>::~threadpool()
 {
-    // 释放id空间即可，脱离线程会自行释放资源
-    delete []m_threads;
+    // 脱离线程会自行释放资源
 }
-//添加读写事件，要改变m_state
+//创建一个线程，并将它设置为脱离线程，退出时自行释放资源
 template <typename T>
-bool threadpool<T>::append(T *request, int state){
-    // 操作工作队列时一定要加锁，因为它被所有线程共享。
-    m_queuelocker.lock();
-    // 判断请求队列是否大于最大请求个数
-    if (m_workqueue.size() >= m_max_requests)
+bool threadpool<T>::spawn()
+{
+    pthread_t tid;
+    m_live.fetch_add(1, std::memory_order_relaxed);
+    // 1标识符，2线程属性（NULL为默认），3指定线程将运行的函数，4运行的参数
+    // 函数原型中的第三个参数，为函数指针，指向处理线程函数的地址。
+    // 该函数，要求为静态函数。如果处理线程函数为类成员函数时，需要将其设置为静态成员函数。
+    // 但静态成员函数不能访问非静态成员变量，所以通过this传递到arg中，再通过它去访问成员变量
+    if (pthread_create(&tid, NULL, worker, this) != 0)
     {
-        m_queuelocker.unlock();
+        m_live.fetch_sub(1, std::memory_order_relaxed);
         return false;
     }
-    // 设置HTTP请求状态
+    pthread_detach(tid);
+    return true;
+}
+//主线程在balance中发放退出名额，空闲线程领到后退出
+template <typename T>
+bool threadpool<T>::retire()
+{
+    int n = m_retire.load(std::memory_order_relaxed);
+    while (n > 0)
+    {
+        if (m_retire.compare_exchange_weak(n, n - 1, std::memory_order_relaxed))
+        {
+            m_live.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+//扩容：没有空闲线程，队列不空，且任务排队过久或者一段时间内没有线程取任务(都阻塞在数据库等操作上)
+//缩容：窗口内空闲线程数的最小值就是多余的线程数，窗口结束时发放同样多的退出名额
+template <typename T>
+void threadpool<T>::balance()
+{
+    if (m_max_threads <= m_thread_number)
+        return;
+    long long now = coarse_clock::get_instance()->now_ms();
+    int live = m_live.load(std::memory_order_relaxed);
+    int idle = live - m_busy.load(std::memory_order_relaxed);
+    if (idle < m_idle_low)
+        m_idle_low = idle;
+
+    int queued = (int)m_workqueue.size_approx();
+    if (idle <= 0 && live < m_max_threads && now - m_last_grow_ms >= GROW_INTERVAL_MS && queued > 0 &&
+        (m_sojourn_ms.load(std::memory_order_relaxed) >= SOJOURN_TARGET_MS ||
+         now - m_last_pop_ms.load(std::memory_order_relaxed) >= SOJOURN_TARGET_MS))
+    {
+        //正在扩容，收回还没被领取的退出名额
+        m_retire.store(0, std::memory_order_relaxed);
+        //按积压的任务数增加，每次至多翻倍，阻塞的线程较多时几次就能补足
+        int grow = queued < live ? queued : live;
+        if (grow > m_max_threads - live)
+            grow = m_max_threads - live;
+        while (grow-- > 0 && spawn())
+            ;
+        m_last_grow_ms = now;
+        m_window_start_ms = now;
+        m_idle_low = INT_MAX;
+        return;
+    }
+
+    if (now - m_window_start_ms >= RETIRE_WINDOW_MS)
+    {
+        int surplus = m_idle_low < live - m_thread_number ? m_idle_low : live - m_thread_number;
+        if (surplus > 0)
+        {
+            m_retire.store(surplus, std::memory_order_relaxed);
+            m_queuestat.notify_all();
+        }
+        m_window_start_ms = now;
+        m_idle_low = INT_MAX;
+    }
+}
+//工作窃取模式下放入目标线程的队列，队列已满时依次尝试后面的线程
+template <typename T>
+bool threadpool<T>::dispatch(T *request)
+{
+    int n = m_thread_number;
+    //同一连接的对象地址不变，按其在数组中的下标选择线程，使连接的状态留在同一个核的缓存中
+    int target = m_sched_mode == SCHED_AFFINITY ? (int)(((uintptr_t)request / sizeof(T)) % n)
+                                                : (int)(m_next_target++ % n);
+    for (int i = 0; i < n; ++i)
+    {
+        int index = (target + i) % n;
+        if (m_slots[index]->inbox.push(request))
+        {
+            wake(index);
+            return true;
+        }
+    }
+    return false;
+}
+//目标线程在休眠就唤醒它，否则它正忙，唤醒一个休眠的线程来窃取
+template <typename T>
+void threadpool<T>::wake(int index)
+{
+    for (int i = 0; i < m_thread_number; ++i)
+    {
+        if (m_slots[(index + i) % m_thread_number]->idle.notify_one())
+            return;
+    }
+}
+//添加读写事件，要改变m_state
+template <typename T>
+bool threadpool<T>::append(T *request, int state){
+    // 设置HTTP请求状态，入队时随任务一起发布给工作线程
     request->m_state = state;
-    // 向工作队列中添加任务
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    // 通过信号量提示有任务要处理
-    m_queuestat.post();
+    if (m_sched_mode != SCHED_SHARED)
+        return dispatch(request);
+    // 请求队列已满
+    task t = {request, coarse_clock::get_instance()->now_ms()};
+    if (!m_workqueue.push(t))
+        return false;
+    // 有线程在休眠时唤醒一个
+    m_queuestat.notify_one();
+    balance();
     return true;
 }
 //添加读完成事件
 template <typename T>
 bool threadpool<T>::append_p(T *request){
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests)
-    {
-        m_queuelocker.unlock();
+    if (m_sched_mode != SCHED_SHARED)
+        return dispatch(request);
+    task t = {request, coarse_clock::get_instance()->now_ms()};
+    if (!m_workqueue.push(t))
         return false;
-    }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
+    m_queuestat.notify_one();
+    balance();
     return true;
 }
 //线程回调函数/工作函数，arg其实是this
@@ -125,29 +288,129 @@ void *threadpool<T>::worker(void *arg)
     pool->run();
     return pool;
 }
+//队列为空时先短暂自旋，任务密集时省去休眠和唤醒的系统调用
+//仍然没有任务则登记等待，登记后再检查一次队列，避免错过登记前入队的任务
+template <typename T>
+T *threadpool<T>::take()
+{
+    task t;
+    while (true)
+    {
+        for (int i = 0; i < 64; ++i)
+        {
+            if (m_workqueue.pop(t))
+                return taken(t);
+            cpu_relax();
+        }
+        int key = m_queuestat.prepare_wait();
+        if (m_workqueue.pop(t))
+        {
+            m_queuestat.cancel_wait();
+            return taken(t);
+        }
+        //队列为空才领取退出名额
+        if (retire())
+        {
+            m_queuestat.cancel_wait();
+            return NULL;
+        }
+        m_queuestat.wait(key);
+    }
+}
+//伸缩开启时记录排队时间
+template <typename T>
+T *threadpool<T>::taken(const task &t)
+{
+    if (m_max_threads > m_thread_number)
+    {
+        long long now = coarse_clock::get_instance()->now_ms();
+        m_sojourn_ms.store((int)(now - t.enqueued), std::memory_order_relaxed);
+        m_last_pop_ms.store(now, std::memory_order_relaxed);
+    }
+    return t.request;
+}
+//依次查找自己的deque、自己的inbox，再从其他线程窃取
+template <typename T>
+T *threadpool<T>::find_task(int index)
+{
+    worker_slot *slot = m_slots[index];
+    T *request = slot->held;
+    if (request)
+    {
+        slot->held = NULL;
+        return request;
+    }
+    request = slot->deque.take();
+    if (request)
+        return request;
+    //从inbox取出一批，第一个立即处理，其余放入deque，可被其他线程窃取
+    if (slot->inbox.pop(request))
+    {
+        T *extra;
+        int moved = 0;
+        while (moved < worker_slot::BATCH - 1 && slot->inbox.pop(extra))
+        {
+            //deque已满时放回inbox；inbox同时又被填满，就留给本线程处理完当前任务后直接处理
+            if (!slot->deque.push(extra))
+            {
+                if (!slot->inbox.push(extra))
+                    slot->held = extra;
+                break;
+            }
+            ++moved;
+        }
+        if (moved)
+            wake((index + 1) % m_thread_number);
+        return request;
+    }
+    for (int i = 1; i < m_thread_number; ++i)
+    {
+        worker_slot *victim = m_slots[(index + i) % m_thread_number];
+        request = victim->deque.steal();
+        if (request || victim->inbox.pop(request))
+            return request;
+    }
+    return NULL;
+}
+//与take相同，先自旋再休眠，休眠前登记后再查找一遍，包括其他线程的队列
+template <typename T>
+T *threadpool<T>::take_local(int index)
+{
+    worker_slot *slot = m_slots[index];
+    T *request;
+    while (true)
+    {
+        for (int i = 0; i < 64; ++i)
+        {
+            if ((request = find_task(index)) != NULL)
+                return request;
+            cpu_relax();
+        }
+        int key = slot->idle.prepare_wait();
+        if ((request = find_task(index)) != NULL)
+        {
+            slot->idle.cancel_wait();
+            return request;
+        }
+        slot->idle.wait(key);
+    }
+}
 //回调函数会调用这个函数工作
-//工作线程就是不断地等任务队列有新任务，然后就加锁取任务->取到任务解锁->执行任务
+//工作线程就是不断地等任务队列有新任务，然后取任务->执行任务
 template <typename T>
 void threadpool<T>::run()
 {
+    int index = m_next_index.fetch_add(1, std::memory_order_relaxed);
+    bool elastic = m_max_threads > m_thread_number;
     // 工作线程从请求队列中取出某个任务进行处理
     while (true)
     {
-        //信号量等待
-        m_queuestat.wait();
-        //唤醒后先加互斥锁
-        m_queuelocker.lock();
-        if(m_workqueue.empty())
-        {
-            m_queuelocker.unlock();
-            continue;
-        }
-        // 取第一个任务后互斥锁解锁
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
+        T *request = m_sched_mode == SCHED_SHARED ? take() : take_local(index);
+        // 线程池缩容，本线程退出
         if (!request)
-            continue;
+            return;
+        if (elastic)
+            m_busy.fetch_add(1, std::memory_order_relaxed);
         // 模式1表示reactor
         if (1 == m_actor_model){
             // 读请求
@@ -159,9 +422,6 @@ void threadpool<T>::run()
                     // 设置improv
                     request->improv = 1;
 
-                    // 从连接池中取出一个数据库连接
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    
                     // 处理http请求的入口
                     request->process();
                 }
@@ -190,10 +450,10 @@ void threadpool<T>::run()
         }
         // 模式0表示proactor
         else{
-            connectionRAII mysqlconn(&request->mysql, m_connPool);
             request->process();
         }
-
+        if (elastic)
+            m_busy.fetch_sub(1, std::memory_order_relaxed);
     }
     
 }
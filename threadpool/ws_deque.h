@@ -0,0 +1,93 @@
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <stddef.h>
+#include <atomic>
+
+// Chase-Lev工作窃取双端队列，容量固定
+// 只有所属线程在底部push和take，其他线程在顶部steal；只剩最后一个元素时双方用CAS争夺顶部
+// 所属线程的push和大多数take只有普通的读写和一次内存屏障，不与窃取者竞争同一个锁
+// 元素按值复制，T应为指针等平凡类型，取不到时返回T()
+template <typename T>
+class ws_deque
+{
+public:
+    static const size_t CACHE_LINE = 64;
+
+    //容量向上取整为2的幂
+    explicit ws_deque(size_t capacity) : m_top(0), m_bottom(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        m_buffer = new std::atomic<T>[size];
+    }
+    ~ws_deque() { delete[] m_buffer; }
+    ws_deque(const ws_deque &) = delete;
+    ws_deque &operator=(const ws_deque &) = delete;
+
+    //所属线程在底部加入，已满时返回false
+    bool push(T value)
+    {
+        long b = m_bottom.load(std::memory_order_relaxed);
+        long t = m_top.load(std::memory_order_acquire);
+        if (b - t > (long)m_mask)
+            return false;
+        m_buffer[b & m_mask].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        m_bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    //所属线程从底部取出最近加入的元素
+    T take()
+    {
+        long b = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = m_top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            //已经空了
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return T();
+        }
+        T value = m_buffer[b & m_mask].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            //最后一个元素，与窃取者争夺
+            if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                value = T();
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    //其他线程从顶部窃取最早加入的元素，为空或与其他线程冲突时返回T()
+    T steal()
+    {
+        long t = m_top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = m_bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return T();
+        T value = m_buffer[t & m_mask].load(std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return T();
+        return value;
+    }
+
+    bool empty() const
+    {
+        return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+    }
+
+private:
+    alignas(CACHE_LINE) std::atomic<long> m_top;        //窃取者竞争的一端
+    alignas(CACHE_LINE) std::atomic<long> m_bottom;     //只有所属线程修改
+    std::atomic<T> *m_buffer;
+    size_t m_mask;
+};
+
+#endif
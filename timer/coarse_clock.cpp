@@ -0,0 +1,73 @@
+#include <string.h>
+#include "coarse_clock.h"
+
+coarse_clock::coarse_clock() : m_seq(0), m_mono_ms(0), m_wall_sec(0)
+{
+    memset(&m_snap, 0, sizeof(m_snap));
+    m_snap.sec = -1;
+    update();
+}
+
+void coarse_clock::update()
+{
+    struct timespec mono, wall;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    clock_gettime(CLOCK_REALTIME, &wall);
+    m_mono_ms.store((long long)mono.tv_sec * 1000 + mono.tv_nsec / 1000000, std::memory_order_relaxed);
+
+    unsigned seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_snap.usec = wall.tv_nsec / 1000;
+    //每秒只格式化一次
+    if (wall.tv_sec != m_snap.sec)
+    {
+        m_snap.sec = wall.tv_sec;
+        localtime_r(&wall.tv_sec, &m_snap.local);
+        strftime(m_snap.log_time, sizeof(m_snap.log_time), "%Y-%m-%d %H:%M:%S", &m_snap.local);
+        struct tm gmt;
+        gmtime_r(&wall.tv_sec, &gmt);
+        strftime(m_snap.http_date, sizeof(m_snap.http_date), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    }
+
+    m_seq.store(seq + 2, std::memory_order_release);
+    m_wall_sec.store(wall.tv_sec, std::memory_order_relaxed);
+}
+
+//顺序锁的读端：序号为奇数或前后不一致说明读的过程中快照被改写，重读
+size_t coarse_clock::log_time(char *out, struct tm *local) const
+{
+    unsigned seq;
+    long usec;
+    do
+    {
+        seq = m_seq.load(std::memory_order_acquire);
+        memcpy(out, m_snap.log_time, 19);
+        usec = m_snap.usec;
+        if (local)
+            *local = m_snap.local;
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != m_seq.load(std::memory_order_relaxed));
+
+    out[19] = '.';
+    //微秒固定6位
+    for (int i = LOG_TIME_LEN - 1; i > 19; --i)
+    {
+        out[i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    return LOG_TIME_LEN;
+}
+
+size_t coarse_clock::http_date(char *out) const
+{
+    unsigned seq;
+    do
+    {
+        seq = m_seq.load(std::memory_order_acquire);
+        memcpy(out, m_snap.http_date, HTTP_DATE_LEN);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || seq != m_seq.load(std::memory_order_relaxed));
+    return HTTP_DATE_LEN;
+}
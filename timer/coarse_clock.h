@@ -0,0 +1,55 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <time.h>
+#include <stddef.h>
+#include <atomic>
+
+// 粗粒度时钟，单例
+// 主线程每轮事件循环调用一次update，其余地方只读缓存的时间，不再各自调用time、gettimeofday和localtime
+// 日志时间戳与HTTP日期按秒预先格式化，秒数不变时update只更新毫秒与微秒
+// 快照用顺序锁保护：只有主线程写，读者发现写入过程中序号变化就重读，不加锁也不阻塞写者
+class coarse_clock
+{
+public:
+    static const size_t LOG_TIME_LEN = 26;      //"2024-01-31 23:59:59.123456"
+    static const size_t HTTP_DATE_LEN = 29;     //"Wed, 31 Jan 2024 23:59:59 GMT"
+
+    static coarse_clock *get_instance()
+    {
+        static coarse_clock instance;
+        return &instance;
+    }
+
+    //重新读取系统时钟，只能由一个线程调用
+    void update();
+
+    //单调时钟的毫秒数，用于定时器
+    long long now_ms() const { return m_mono_ms.load(std::memory_order_relaxed); }
+    //墙上时间的秒数
+    time_t now() const { return m_wall_sec.load(std::memory_order_relaxed); }
+
+    //写入LOG_TIME_LEN字节的日志时间戳，不加结尾的\0；local不为NULL时同时给出本地时间，用于按天切分日志
+    size_t log_time(char *out, struct tm *local = NULL) const;
+    //写入HTTP_DATE_LEN字节的RFC 7231日期，不加结尾的\0
+    size_t http_date(char *out) const;
+
+private:
+    coarse_clock();
+
+    struct snapshot
+    {
+        time_t sec;
+        long usec;
+        struct tm local;
+        char log_time[20];      //"2024-01-31 23:59:59"，不含微秒
+        char http_date[HTTP_DATE_LEN + 1];
+    };
+
+    snapshot m_snap;
+    std::atomic<unsigned> m_seq;    //奇数表示正在写
+    std::atomic<long long> m_mono_ms;
+    std::atomic<time_t> m_wall_sec;
+};
+
+#endif
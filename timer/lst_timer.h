@@ -22,69 +22,81 @@
 #include <sys/uio.h>
 
 #include <time.h>
+#include "coarse_clock.h"
 //#include "../log/log.h"
 
-//连接资源结构体成员需要用到定时器类
-//需要前向声明
-class util_timer;
-struct client_data
-{
-    //客户端socket地址
-    sockaddr_in address;
-    //socket文件描述符
-    int sockfd;
-    //定时器
-    util_timer *timer;
-};
+struct client_data;
 
-//定时器结点类
+//定时器结点，嵌入在连接资源中，不单独分配
 class util_timer
 {
 public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : expire(0), cb_func(NULL), user_data(NULL), prev(NULL), next(NULL), slot(-1) {}
+
+    bool pending() const { return slot >= 0; }
 
 public:
-    //超时时间
-    time_t expire;
+    //超时时间，单调时钟的毫秒数
+    long long expire;
     //回调函数
     void (* cb_func)(client_data *);
     //连接资源
     client_data *user_data;
-    //前向定时器
+    //所在槽中的前后结点
     util_timer *prev;
-    //后继定时器
     util_timer *next;
+    //所在的槽，未加入时间轮时为-1
+    int slot;
+};
+
+struct client_data
+{
+    //客户端socket地址
+    sockaddr_in address;
+    //socket文件描述符
+    int sockfd;
+    //定时器
+    util_timer timer;
 };
 
-class sort_timer_lst
+//分层时间轮
+//每层64个槽，第0层每槽一个刻度，第n层每槽64^n个刻度，4层可覆盖64^4个刻度，更远的超时放在最后一层的最远处
+//加入、调整、删除都只是在槽的双向链表上摘挂结点，与定时器数量无关
+//时间前进到第n层的槽的边界时，把高一层对应槽中的定时器按剩余时间重新分配到低层
+class timer_wheel
 {
 public:
-    sort_timer_lst();
-    ~sort_timer_lst();
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    timer_wheel();
+
+    //now为当前毫秒数，resolution为一个刻度的毫秒数
+    void init(long long now, int resolution);
 
-    //外部添加定时器，内部调用私有成员add_timer
-    //若当前链表中只有头尾节点，直接插入
-    //否则，将定时器按升序插入
+    //按timer->expire加入时间轮，已在时间轮中的定时器先取出再加入
     void add_timer(util_timer *timer);
 
-    //adjust_timer函数，当定时任务发生变化,调整对应定时器在链表中的位置
-    //客户端在设定时间内有数据收发,则当前时刻对该定时器重新设定时间，这里只是往后延长超时时间
-    //被调整的目标定时器在尾部，或定时器新的超时值仍然小于下一个定时器的超时，不用调整
-    //否则先将定时器从链表取出，重新插入链表
+    //超时时间改变后调整定时器的位置，与add_timer相同
     void adjust_timer(util_timer *timer);
 
-    //del_timer函数将超时的定时器从链表中删除
-    //常规双向链表删除结点
+    //从时间轮中取出定时器，不在时间轮中时什么也不做
     void del_timer(util_timer *timer);
-    
-    //定时任务处理函数
-    void tick();
+
+    //前进到now，执行到期定时器的回调
+    void tick(long long now);
+
+    size_t size() const { return m_count; }
 
 private:
-    void add_timer(util_timer *timer, util_timer *lst_head);
+    void link(util_timer *timer, int slot);
+    void cascade(int level, int index);
 
-    util_timer *head;
-    util_timer *tail;
+    util_timer *m_slots[LEVELS * SLOTS];
+    long long m_current;        //下一个要处理的刻度
+    int m_resolution;
+    size_t m_count;
 };
 
 class Utils
@@ -115,8 +127,8 @@ public:
 public:
     //信号管道，所有连接共用
     static int *u_pipefd;
-    //定时器排序链表
-    sort_timer_lst m_timer_lst;
+    //定时器时间轮
+    timer_wheel m_timer_wheel;
     static int u_epollfd;
     //最小超时单位
     int m_TIMESLOT;
@@ -0,0 +1,125 @@
+#include "lst_timer.h"
+
+timer_wheel::timer_wheel() : m_current(0), m_resolution(1000), m_count(0)
+{
+    memset(m_slots, 0, sizeof(m_slots));
+}
+
+void timer_wheel::init(long long now, int resolution)
+{
+    m_resolution = resolution;
+    m_current = now / resolution;
+}
+
+void timer_wheel::add_timer(util_timer *timer)
+{
+    if (!timer)
+    {
+        return;
+    }
+    if (timer->pending())
+        del_timer(timer);
+
+    //向上取整到刻度，保证回调执行时当前时间不早于expire
+    long long expire = (timer->expire + m_resolution - 1) / m_resolution;
+    //已经过期的在下一个刻度执行
+    if (expire < m_current)
+        expire = m_current;
+    long long delta = expire - m_current;
+    const long long max_delta = (1LL << (SLOT_BITS * LEVELS)) - 1;
+    if (delta > max_delta)
+    {
+        //超出时间轮范围，先放在最远处，层层下放时按真实的expire重新分配
+        expire = m_current + max_delta;
+        delta = max_delta;
+    }
+    //剩余刻度数决定所在的层，层内的槽由expire对应的位决定
+    int level = 0;
+    while (delta >= (1LL << (SLOT_BITS * (level + 1))))
+        ++level;
+    int index = (expire >> (SLOT_BITS * level)) & (SLOTS - 1);
+    link(timer, level * SLOTS + index);
+}
+
+void timer_wheel::adjust_timer(util_timer *timer)
+{
+    add_timer(timer);
+}
+
+void timer_wheel::del_timer(util_timer *timer)
+{
+    if (!timer || !timer->pending())
+    {
+        return;
+    }
+    //常规双向链表删除结点，槽的头结点没有前驱
+    if (timer->prev)
+        timer->prev->next = timer->next;
+    else
+        m_slots[timer->slot] = timer->next;
+    if (timer->next)
+        timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+    timer->slot = -1;
+    --m_count;
+}
+
+void timer_wheel::tick(long long now)
+{
+    long long target = now / m_resolution;
+    while (m_current <= target)
+    {
+        int index = m_current & (SLOTS - 1);
+        //第0层转完一圈，从高层取出接下来一段时间内到期的定时器
+        if (index == 0)
+        {
+            for (int level = 1; level < LEVELS; ++level)
+            {
+                int upper = (m_current >> (SLOT_BITS * level)) & (SLOTS - 1);
+                cascade(level, upper);
+                if (upper != 0)
+                    break;
+            }
+        }
+        //先前进再执行回调，回调中重新加入的定时器不会落回正在处理的槽
+        ++m_current;
+        util_timer *tmp;
+        while ((tmp = m_slots[index]) != NULL)
+        {
+            del_timer(tmp);
+            //当前定时器到期，则调用回调函数，执行定时事件
+            tmp->cb_func(tmp->user_data);
+        }
+    }
+}
+
+void timer_wheel::link(util_timer *timer, int slot)
+{
+    util_timer *head = m_slots[slot];
+    timer->prev = NULL;
+    timer->next = head;
+    if (head)
+        head->prev = timer;
+    m_slots[slot] = timer;
+    timer->slot = slot;
+    ++m_count;
+}
+
+//把高层一个槽中的定时器按剩余时间重新加入
+void timer_wheel::cascade(int level, int index)
+{
+    int slot = level * SLOTS + index;
+    util_timer *tmp = m_slots[slot];
+    m_slots[slot] = NULL;
+    while (tmp)
+    {
+        util_timer *next = tmp->next;
+        tmp->prev = NULL;
+        tmp->next = NULL;
+        tmp->slot = -1;
+        --m_count;
+        add_timer(tmp);
+        tmp = next;
+    }
+}
@@ -0,0 +1,296 @@
+// 静态资源打包工具
+// 用法：bundle_pack <网站根目录> <输出文件>
+// 把目录下的所有普通文件连同预先计算好的大小、ETag、Last-Modified、MIME类型和压缩版本写入一个资源包
+// 服务器用-b参数加载，启动时整体映射，之后按路径一次哈希查找即可取得文件
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <charconv>
+#include <string>
+#include <vector>
+#include "../cache/bundle_format.h"
+#include "../http/mime_types.h"
+
+using namespace std;
+
+static const char *encoding_suffix[BUNDLE_ENCODINGS] = {".gz", ".br"};
+
+struct pack_file
+{
+    string name;                    //相对根目录的路径，以/开头
+    string data;
+    string variant[BUNDLE_ENCODINGS];
+    struct stat st;
+};
+
+static bool read_file(const string &path, string &out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    out.clear();
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        out.append(buf, n);
+    close(fd);
+    return n == 0;
+}
+
+static bool has_suffix(const string &s, const char *suffix)
+{
+    size_t len = strlen(suffix);
+    return s.size() > len && s.compare(s.size() - len, len, suffix) == 0;
+}
+
+//递归收集目录下的普通文件
+static bool collect(const string &root, const string &dir, vector<pack_file> &files)
+{
+    DIR *d = opendir((root + dir).c_str());
+    if (!d)
+    {
+        fprintf(stderr, "opendir %s%s failed\n", root.c_str(), dir.c_str());
+        return false;
+    }
+    struct dirent *ent;
+    bool ok = true;
+    while (ok && (ent = readdir(d)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        string name = dir + "/" + ent->d_name;
+        struct stat st;
+        if (stat((root + name).c_str(), &st) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            ok = collect(root, name, files);
+            continue;
+        }
+        //和服务器一样，只打包对所有用户可读的普通文件
+        if (!S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH))
+            continue;
+        pack_file f;
+        f.name = name;
+        f.st = st;
+        if (!read_file(root + name, f.data))
+        {
+            fprintf(stderr, "read %s failed\n", name.c_str());
+            ok = false;
+            break;
+        }
+        files.push_back(f);
+    }
+    closedir(d);
+    return ok;
+}
+
+//gzip压缩，体积缩小不足10%时放弃
+static bool gzip(const string &in, string &out)
+{
+    if (in.size() < 256)
+        return false;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END && out.size() < in.size() * 9 / 10;
+}
+
+static uint64_t content_hash(const string &data)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t align_up(uint64_t v)
+{
+    return (v + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN * BUNDLE_ALIGN;
+}
+
+static void fill_record(bundle_record &r, const pack_file &f)
+{
+    //ETag只取决于内容，重新打包或换机器部署时不变
+    char *p = r.etag;
+    char *end = r.etag + sizeof(r.etag) - 1;
+    *p++ = '"';
+    p = to_chars(p, end, content_hash(f.data), 16).ptr;
+    *p++ = '-';
+    p = to_chars(p, end, (unsigned long long)f.data.size(), 16).ptr;
+    *p++ = '"';
+    *p = '\0';
+
+    struct tm tm;
+    gmtime_r(&f.st.st_mtime, &tm);
+    strftime(r.last_modified, sizeof(r.last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    const mime_type &mime = mime_lookup(f.name);
+    size_t len = min(mime.type.size(), sizeof(r.content_type) - 1);
+    memcpy(r.content_type, mime.type.data(), len);
+    r.content_type[len] = '\0';
+    r.compressible = mime.compressible;
+    r.mtime_sec = f.st.st_mtim.tv_sec;
+    r.mtime_nsec = f.st.st_mtim.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <root> <bundle>\n", argv[0]);
+        return 1;
+    }
+    string root = argv[1];
+    while (root.size() > 1 && root.back() == '/')
+        root.pop_back();
+
+    vector<pack_file> all;
+    if (!collect(root, "", all))
+        return 1;
+
+    //预压缩的.gz/.br文件作为原文件的压缩版本，不单独成为条目
+    vector<pack_file> files;
+    for (size_t i = 0; i < all.size(); ++i)
+    {
+        bool variant = false;
+        for (int e = 0; e < BUNDLE_ENCODINGS && !variant; ++e)
+        {
+            if (!has_suffix(all[i].name, encoding_suffix[e]))
+                continue;
+            string base = all[i].name.substr(0, all[i].name.size() - strlen(encoding_suffix[e]));
+            for (size_t j = 0; j < all.size(); ++j)
+            {
+                if (all[j].name == base)
+                {
+                    variant = true;
+                    break;
+                }
+            }
+        }
+        if (!variant)
+            files.push_back(all[i]);
+    }
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        pack_file &f = files[i];
+        for (int e = 0; e < BUNDLE_ENCODINGS; ++e)
+        {
+            for (size_t j = 0; j < all.size(); ++j)
+            {
+                //与服务器相同，比原文件旧的预压缩文件视为过期
+                if (all[j].name == f.name + encoding_suffix[e] && all[j].st.st_mtime >= f.st.st_mtime)
+                    f.variant[e] = all[j].data;
+            }
+        }
+        if (f.variant[0].empty() && mime_lookup(f.name).compressible)
+        {
+            string out;
+            if (gzip(f.data, out))
+                f.variant[0] = out;
+        }
+    }
+
+    //布局：头部、记录、哈希槽、文件名，之后是对齐的文件内容
+    bundle_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+    header.version = BUNDLE_VERSION;
+    header.count = files.size();
+    header.slot_count = 1;
+    while (header.slot_count < 2 * files.size() + 1)
+        header.slot_count <<= 1;
+    header.records_offset = sizeof(header);
+    header.slots_offset = header.records_offset + files.size() * sizeof(bundle_record);
+    header.names_offset = header.slots_offset + header.slot_count * sizeof(uint32_t);
+
+    vector<bundle_record> records(files.size());
+    vector<uint32_t> slots(header.slot_count, 0);
+    string names;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        bundle_record &r = records[i];
+        memset(&r, 0, sizeof(r));
+        r.name_offset = names.size();
+        r.name_len = files[i].name.size();
+        r.hash = bundle_hash(files[i].name);
+        names += files[i].name;
+        fill_record(r, files[i]);
+        uint32_t mask = header.slot_count - 1;
+        uint32_t slot = r.hash & mask;
+        while (slots[slot])
+            slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
+    }
+
+    uint64_t offset = align_up(header.names_offset + names.size());
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        records[i].offset = offset;
+        records[i].size = files[i].data.size();
+        offset = align_up(offset + files[i].data.size());
+        for (int e = 0; e < BUNDLE_ENCODINGS; ++e)
+        {
+            if (files[i].variant[e].empty())
+                continue;
+            records[i].variant_offset[e] = offset;
+            records[i].variant_size[e] = files[i].variant[e].size();
+            offset = align_up(offset + files[i].variant[e].size());
+        }
+    }
+    header.size = offset;
+
+    //先写到临时文件再改名，正在运行的服务器映射的旧包不受影响
+    string tmp = string(argv[2]) + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "open %s failed\n", tmp.c_str());
+        return 1;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+              (records.empty() || fwrite(&records[0], sizeof(bundle_record), records.size(), out) == records.size()) &&
+              fwrite(&slots[0], sizeof(uint32_t), slots.size(), out) == slots.size() &&
+              fwrite(names.data(), 1, names.size(), out) == names.size();
+    for (size_t i = 0; ok && i < files.size(); ++i)
+    {
+        const string *blobs[1 + BUNDLE_ENCODINGS] = {&files[i].data, &files[i].variant[0], &files[i].variant[1]};
+        uint64_t offsets[1 + BUNDLE_ENCODINGS] = {records[i].offset, records[i].variant_offset[0], records[i].variant_offset[1]};
+        for (int b = 0; ok && b < 1 + BUNDLE_ENCODINGS; ++b)
+        {
+            if (b > 0 && !offsets[b])
+                continue;
+            ok = fseek(out, offsets[b], SEEK_SET) == 0 &&
+                 fwrite(blobs[b]->data(), 1, blobs[b]->size(), out) == blobs[b]->size();
+        }
+    }
+    //末尾补齐到header.size
+    ok = ok && fflush(out) == 0 && ftruncate(fileno(out), header.size) == 0;
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), argv[2]) < 0)
+    {
+        fprintf(stderr, "write %s failed\n", argv[2]);
+        unlink(tmp.c_str());
+        return 1;
+    }
+    printf("packed %zu files into %s (%llu bytes)\n", files.size(), argv[2], (unsigned long long)header.size);
+    return 0;
+}
@@ -0,0 +1,294 @@
+// 请求队列性能对比：std::list加互斥锁和信号量(原来的实现) 与 无锁环形队列加event_count(现在的实现)
+// 用法：queue_bench [每轮传递的任务数，默认1000000]
+//       queue_bench stress [每个生产者的任务数，默认1000000]
+// 工作线程数取1到64，分两组：
+//   1个生产者：对应服务器主线程把请求交给工作线程
+//   生产者数等于工作线程数：所有线程同时争用队列
+// 队列容量与服务器默认的max_requests相同，满时生产者让出CPU后重试，输出每秒传递的任务数(百万)
+// stress：8个生产者、8个消费者经由容量64的环形队列传递，队列反复绕圈、写满和读空，
+// 检查每个任务恰好被取出一次，且同一消费者看到的同一生产者的任务保持入队顺序
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <vector>
+#include <pthread.h>
+#include "../lock/locker.h"
+#include "../threadpool/mpmc_queue.h"
+
+using namespace std;
+
+static const int MAX_REQUESTS = 10000;
+static const long STOP = 0;         //消费者收到后退出
+
+//原来线程池的请求队列：append与run中的取任务逻辑
+class list_queue
+{
+public:
+    bool push(long value)
+    {
+        m_queuelocker.lock();
+        if (m_workqueue.size() >= MAX_REQUESTS)
+        {
+            m_queuelocker.unlock();
+            return false;
+        }
+        m_workqueue.push_back(value);
+        m_queuelocker.unlock();
+        m_queuestat.post();
+        return true;
+    }
+    long pop()
+    {
+        while (true)
+        {
+            m_queuestat.wait();
+            m_queuelocker.lock();
+            if (m_workqueue.empty())
+            {
+                m_queuelocker.unlock();
+                continue;
+            }
+            long value = m_workqueue.front();
+            m_workqueue.pop_front();
+            m_queuelocker.unlock();
+            return value;
+        }
+    }
+
+private:
+    list<long> m_workqueue;
+    locker m_queuelocker;
+    sem m_queuestat;
+};
+
+//现在线程池的请求队列：append与take中的取任务逻辑
+class ring_queue
+{
+public:
+    explicit ring_queue(size_t capacity = MAX_REQUESTS) : m_workqueue(capacity) {}
+
+    bool push(long value)
+    {
+        if (!m_workqueue.push(value))
+            return false;
+        m_queuestat.notify_one();
+        return true;
+    }
+    long pop()
+    {
+        long value;
+        while (true)
+        {
+            for (int i = 0; i < 64; ++i)
+            {
+                if (m_workqueue.pop(value))
+                    return value;
+                cpu_relax();
+            }
+            int key = m_queuestat.prepare_wait();
+            if (m_workqueue.pop(value))
+            {
+                m_queuestat.cancel_wait();
+                return value;
+            }
+            m_queuestat.wait(key);
+        }
+    }
+
+private:
+    mpmc_queue<long> m_workqueue;
+    event_count m_queuestat;
+};
+
+template <typename Q>
+struct bench_arg
+{
+    Q *queue;
+    long count;
+    long sum;
+};
+
+template <typename Q>
+static void push_retry(Q *queue, long value)
+{
+    while (!queue->push(value))
+        sched_yield();
+}
+
+template <typename Q>
+static void *producer(void *arg)
+{
+    bench_arg<Q> *a = (bench_arg<Q> *)arg;
+    for (long i = 1; i <= a->count; ++i)
+        push_retry(a->queue, i);
+    return NULL;
+}
+
+template <typename Q>
+static void *consumer(void *arg)
+{
+    bench_arg<Q> *a = (bench_arg<Q> *)arg;
+    long value;
+    while ((value = a->queue->pop()) != STOP)
+        a->sum += value;
+    return NULL;
+}
+
+//返回每秒传递的任务数(百万)，校验和不对时返回负数
+template <typename Q>
+static double run(int producers, int consumers, long items)
+{
+    Q queue;
+    long per_producer = items / producers;
+    vector<pthread_t> threads(producers + consumers);
+    vector<bench_arg<Q>> args(producers + consumers);
+    for (int i = 0; i < producers + consumers; ++i)
+    {
+        args[i].queue = &queue;
+        args[i].count = per_producer;
+        args[i].sum = 0;
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < consumers; ++i)
+        pthread_create(&threads[producers + i], NULL, consumer<Q>, &args[producers + i]);
+    for (int i = 0; i < producers; ++i)
+        pthread_create(&threads[i], NULL, producer<Q>, &args[i]);
+    for (int i = 0; i < producers; ++i)
+        pthread_join(threads[i], NULL);
+    for (int i = 0; i < consumers; ++i)
+        push_retry(&queue, STOP);
+    for (int i = 0; i < consumers; ++i)
+        pthread_join(threads[producers + i], NULL);
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    long sum = 0;
+    for (int i = 0; i < consumers; ++i)
+        sum += args[producers + i].sum;
+    if (sum != producers * (per_producer * (per_producer + 1) / 2))
+        return -1;
+    return producers * per_producer / secs / 1e6;
+}
+
+static const int STRESS_THREADS = 8;
+
+struct stress_arg
+{
+    ring_queue *queue;
+    long count;
+    int id;
+    atomic<unsigned char> *seen;    //每个任务被取出的次数
+    long errors;
+};
+
+//任务编码为 生产者编号*count + 序号 + 1，0留给STOP
+static void *stress_producer(void *arg)
+{
+    stress_arg *a = (stress_arg *)arg;
+    for (long i = 0; i < a->count; ++i)
+        push_retry(a->queue, a->id * a->count + i + 1);
+    return NULL;
+}
+
+static void *stress_consumer(void *arg)
+{
+    stress_arg *a = (stress_arg *)arg;
+    long last[STRESS_THREADS];
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        last[i] = -1;
+    long value;
+    while ((value = a->queue->pop()) != STOP)
+    {
+        long index = value - 1;
+        int from = index / a->count;
+        long seq = index % a->count;
+        if (from < 0 || from >= STRESS_THREADS || seq <= last[from])
+            ++a->errors;
+        else
+            last[from] = seq;
+        a->seen[index].fetch_add(1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static int stress(long count)
+{
+    ring_queue queue(64);
+    long total = STRESS_THREADS * count;
+    atomic<unsigned char> *seen = new atomic<unsigned char>[total];
+    for (long i = 0; i < total; ++i)
+        seen[i].store(0, memory_order_relaxed);
+
+    pthread_t threads[2 * STRESS_THREADS];
+    stress_arg args[2 * STRESS_THREADS];
+    for (int i = 0; i < 2 * STRESS_THREADS; ++i)
+    {
+        args[i].queue = &queue;
+        args[i].count = count;
+        args[i].id = i;
+        args[i].seen = seen;
+        args[i].errors = 0;
+    }
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        pthread_create(&threads[STRESS_THREADS + i], NULL, stress_consumer, &args[STRESS_THREADS + i]);
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        pthread_create(&threads[i], NULL, stress_producer, &args[i]);
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        push_retry(&queue, STOP);
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        pthread_join(threads[STRESS_THREADS + i], NULL);
+
+    long out_of_order = 0, lost = 0, duplicated = 0;
+    for (int i = 0; i < STRESS_THREADS; ++i)
+        out_of_order += args[STRESS_THREADS + i].errors;
+    for (long i = 0; i < total; ++i)
+    {
+        unsigned char n = seen[i].load(memory_order_relaxed);
+        if (n == 0)
+            ++lost;
+        else if (n > 1)
+            ++duplicated;
+    }
+    delete[] seen;
+    printf("%d producers, %d consumers, %ld items: lost %ld, duplicated %ld, out of order %ld\n",
+           STRESS_THREADS, STRESS_THREADS, total, lost, duplicated, out_of_order);
+    return lost || duplicated || out_of_order ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "stress") == 0)
+    {
+        long count = argc > 2 ? atol(argv[2]) : 1000000;
+        if (count <= 0)
+        {
+            fprintf(stderr, "usage: %s stress [items per producer]\n", argv[0]);
+            return 1;
+        }
+        return stress(count);
+    }
+    long items = argc > 1 ? atol(argv[1]) : 1000000;
+    if (items <= 0)
+    {
+        fprintf(stderr, "usage: %s [items] | stress [items per producer]\n", argv[0]);
+        return 1;
+    }
+    static const int workers[] = {1, 2, 4, 8, 16, 32, 64};
+    printf("million items per second, %ld items per run, %ld cpus\n", items, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %12s %12s %12s %12s\n", "workers", "1p list", "1p ring", "np list", "np ring");
+    for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); ++i)
+    {
+        int n = workers[i];
+        printf("%-8d %12.2f %12.2f %12.2f %12.2f\n", n,
+               run<list_queue>(1, n, items), run<ring_queue>(1, n, items),
+               run<list_queue>(n, n, items), run<ring_queue>(n, n, items));
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,337 @@
+// 定时器性能对比：升序链表(sort_timer_lst)与分层时间轮(timer_wheel)
+// 用法：timer_bench [每个阶段的操作数，默认500，不超过最小规模的一半]
+// 分别在1k、10k、100k个定时器下测量加入、调整、到期处理与删除的平均耗时
+// 先放入N个超时时间在空闲超时内均匀分布的定时器(不计时)，再依次计时：
+//   加入：取出ops个定时器后按新连接重新加入，超时时间为当前时间加空闲超时
+//   调整：随机选ops个定时器，把超时时间延长到当前时间加空闲超时，模拟连接上有数据收发
+//   到期：时间逐秒前进，每秒tick一次，按到期的定时器个数平均
+//   删除：删除另外ops个定时器
+// sort_timer_lst是改用时间轮之前lst_timer中的实现，只去掉了结点的delete(结点由调用者持有)，
+// tick改为传入当前时间；两边的超时时间都用毫秒，避免链表因大量相同的秒数退化得比实际更严重
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "../timer/lst_timer.h"
+
+using namespace std;
+
+static const int IDLE_TIMEOUT = 15;     //秒，与服务器的空闲超时相同
+
+//原来的升序双向链表
+struct list_timer
+{
+    list_timer() : expire(0), user_data(NULL), prev(NULL), next(NULL) {}
+
+    long long expire;
+    void (*cb_func)(list_timer *);
+    void *user_data;
+    list_timer *prev;
+    list_timer *next;
+};
+
+class sort_timer_lst
+{
+public:
+    sort_timer_lst() : head(NULL), tail(NULL) {}
+
+    void add_timer(list_timer *timer)
+    {
+        if (!timer)
+            return;
+        if (!head)
+        {
+            head = tail = timer;
+            return;
+        }
+        if (timer->expire < head->expire)
+        {
+            timer->next = head;
+            head->prev = timer;
+            head = timer;
+            return;
+        }
+        add_timer(timer, head);
+    }
+    void adjust_timer(list_timer *timer)
+    {
+        if (!timer)
+            return;
+        list_timer *tmp = timer->next;
+        if (!tmp || (timer->expire < tmp->expire))
+            return;
+        if (timer == head)
+        {
+            head = head->next;
+            head->prev = NULL;
+            timer->next = NULL;
+            add_timer(timer, head);
+        }
+        else
+        {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+            add_timer(timer, timer->next);
+        }
+    }
+    void del_timer(list_timer *timer)
+    {
+        if (!timer)
+            return;
+        if ((timer == head) && (timer == tail))
+        {
+            head = NULL;
+            tail = NULL;
+        }
+        else if (timer == head)
+        {
+            head = head->next;
+            head->prev = NULL;
+        }
+        else if (timer == tail)
+        {
+            tail = tail->prev;
+            tail->next = NULL;
+        }
+        else
+        {
+            timer->prev->next = timer->next;
+            timer->next->prev = timer->prev;
+        }
+        timer->prev = timer->next = NULL;
+    }
+    void tick(long long cur)
+    {
+        list_timer *tmp = head;
+        while (tmp)
+        {
+            if (cur < tmp->expire)
+                break;
+            head = tmp->next;
+            if (head)
+                head->prev = NULL;
+            tmp->prev = tmp->next = NULL;
+            tmp->cb_func(tmp);
+            tmp = head;
+        }
+    }
+
+private:
+    void add_timer(list_timer *timer, list_timer *lst_head)
+    {
+        list_timer *prev = lst_head;
+        list_timer *tmp = prev->next;
+        while (tmp)
+        {
+            if (timer->expire < tmp->expire)
+            {
+                prev->next = timer;
+                timer->next = tmp;
+                tmp->prev = timer;
+                timer->prev = prev;
+                break;
+            }
+            prev = tmp;
+            tmp = tmp->next;
+        }
+        if (!tmp)
+        {
+            prev->next = timer;
+            timer->prev = prev;
+            timer->next = NULL;
+            tail = timer;
+        }
+    }
+
+    list_timer *head;
+    list_timer *tail;
+};
+
+//两种结构使用相同的随机序列
+struct rng
+{
+    explicit rng(unsigned long long seed) : s(seed) {}
+    unsigned long long next()
+    {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    unsigned long long s;
+};
+
+//各阶段每次操作的平均纳秒数
+struct result
+{
+    double add;
+    double adjust;
+    double tick;        //每个到期定时器
+    double del;
+};
+
+typedef chrono::steady_clock bench_clock;
+
+static const long long START_MS = 1000000;
+
+static double ns_per(bench_clock::time_point start, long long count)
+{
+    double ns = chrono::duration<double, nano>(bench_clock::now() - start).count();
+    return count > 0 ? ns / count : 0;
+}
+
+static long long list_fired = 0;
+static void list_expired(list_timer *)
+{
+    ++list_fired;
+}
+
+static long long wheel_fired = 0;
+static void wheel_expired(client_data *)
+{
+    ++wheel_fired;
+}
+
+//初始超时时间在空闲超时内均匀分布，两种结构相同
+static vector<long long> initial_expires(int n)
+{
+    rng r(n);
+    vector<long long> expires(n);
+    for (int i = 0; i < n; ++i)
+        expires[i] = START_MS + 1000 + (long long)(r.next() % (IDLE_TIMEOUT * 1000));
+    return expires;
+}
+
+static result bench_list(int n, int ops)
+{
+    result res;
+    rng r(n + 1);
+    vector<long long> expires = initial_expires(n);
+    vector<list_timer> nodes(n);
+    sort_timer_lst lst;
+    long long now_ms = START_MS;
+
+    //按超时时间从大到小加入，每次都落在表头，避免初始化本身成为O(N^2)
+    vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+        order[i] = i;
+    sort(order.begin(), order.end(), [&](int a, int b) { return expires[a] > expires[b]; });
+    for (int i = 0; i < n; ++i)
+    {
+        list_timer *t = &nodes[order[i]];
+        t->expire = expires[order[i]];
+        t->cb_func = list_expired;
+        lst.add_timer(t);
+    }
+
+    for (int i = 0; i < ops; ++i)
+        lst.del_timer(&nodes[i]);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < ops; ++i)
+    {
+        nodes[i].expire = now_ms + IDLE_TIMEOUT * 1000;
+        lst.add_timer(&nodes[i]);
+    }
+    res.add = ns_per(start, ops);
+
+    start = bench_clock::now();
+    for (int i = 0; i < ops; ++i)
+    {
+        list_timer *t = &nodes[r.next() % n];
+        t->expire = now_ms + IDLE_TIMEOUT * 1000;
+        lst.adjust_timer(t);
+    }
+    res.adjust = ns_per(start, ops);
+
+    start = bench_clock::now();
+    for (int i = ops; i < 2 * ops; ++i)
+        lst.del_timer(&nodes[i]);
+    res.del = ns_per(start, ops);
+
+    list_fired = 0;
+    start = bench_clock::now();
+    for (int s = 0; s <= IDLE_TIMEOUT; ++s)
+    {
+        now_ms += 1000;
+        lst.tick(now_ms);
+    }
+    res.tick = ns_per(start, list_fired);
+    return res;
+}
+
+static result bench_wheel(int n, int ops)
+{
+    result res;
+    rng r(n + 1);
+    vector<long long> expires = initial_expires(n);
+    vector<client_data> users(n);
+    timer_wheel wheel;
+    long long now_ms = START_MS;
+    wheel.init(now_ms, 1000);
+
+    for (int i = 0; i < n; ++i)
+    {
+        util_timer *t = &users[i].timer;
+        t->expire = expires[i];
+        t->cb_func = wheel_expired;
+        t->user_data = &users[i];
+        wheel.add_timer(t);
+    }
+
+    for (int i = 0; i < ops; ++i)
+        wheel.del_timer(&users[i].timer);
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < ops; ++i)
+    {
+        users[i].timer.expire = now_ms + IDLE_TIMEOUT * 1000;
+        wheel.add_timer(&users[i].timer);
+    }
+    res.add = ns_per(start, ops);
+
+    start = bench_clock::now();
+    for (int i = 0; i < ops; ++i)
+    {
+        util_timer *t = &users[r.next() % n].timer;
+        t->expire = now_ms + IDLE_TIMEOUT * 1000;
+        wheel.adjust_timer(t);
+    }
+    res.adjust = ns_per(start, ops);
+
+    start = bench_clock::now();
+    for (int i = ops; i < 2 * ops; ++i)
+        wheel.del_timer(&users[i].timer);
+    res.del = ns_per(start, ops);
+
+    wheel_fired = 0;
+    start = bench_clock::now();
+    for (int s = 0; s <= IDLE_TIMEOUT; ++s)
+    {
+        now_ms += 1000;
+        wheel.tick(now_ms);
+    }
+    res.tick = ns_per(start, wheel_fired);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int ops = argc > 1 ? atoi(argv[1]) : 500;
+    static const int sizes[] = {1000, 10000, 100000};
+    //加入和删除各用一组不重叠的定时器
+    if (ops <= 0 || 2 * ops > sizes[0])
+    {
+        fprintf(stderr, "usage: %s [ops], 0 < ops <= %d\n", argv[0], sizes[0] / 2);
+        return 1;
+    }
+    printf("ns per operation, %d operations per phase\n", ops);
+    printf("%-8s %-6s %10s %10s %10s %10s\n", "timers", "impl", "add", "adjust", "delete", "expire");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
+    {
+        result l = bench_list(sizes[i], ops);
+        result w = bench_wheel(sizes[i], ops);
+        printf("%-8d %-6s %10.1f %10.1f %10.1f %10.1f\n", sizes[i], "list", l.add, l.adjust, l.del, l.tick);
+        printf("%-8d %-6s %10.1f %10.1f %10.1f %10.1f\n", sizes[i], "wheel", w.add, w.adjust, w.del, w.tick);
+    }
+    return 0;
+}
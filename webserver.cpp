@@ -16,6 +16,9 @@ WebServer::WebServer()
 
     //定时器
     users_timer = new client_data[MAX_FD];
+
+    m_inotifyfd = -1;
+    m_iofd = -1;
 }
 
 WebServer::~WebServer()
@@ -30,7 +33,10 @@ WebServer::~WebServer()
 }
 
 void WebServer::init(int port, string user,string passWord,string databaseName,int log_write, 
-                     int opt_linger, int trigmode, int sql_num,int thread_num, int close_log, int actor_model)
+                     int opt_linger, int trigmode, int sql_num,int thread_num, int close_log, int actor_model,
+                     int upload_threshold, int cache_size, int send_mode, int prerender_size,
+                     string cache_rules, int io_threads, string bundle_path, int zerocopy_size,
+                     int sched_mode, int max_thread_num, const conn_limits &limits)
 {
     m_port = port;
     m_user = user;
@@ -41,8 +47,19 @@ void WebServer::init(int port, string user,string passWord,string databaseName,i
     m_TRIGMode = trigmode;
     m_sql_num = sql_num;
     m_thread_num = thread_num;
+    m_sched_mode = sched_mode;
+    m_max_thread_num = max_thread_num;
     m_close_log = close_log;
     m_actormodel = actor_model;
+    m_upload_threshold = upload_threshold;
+    m_cache_size = cache_size;
+    m_send_mode = send_mode;
+    m_prerender_size = prerender_size;
+    m_cache_rules = cache_rules;
+    m_io_threads = io_threads;
+    m_bundle_path = bundle_path;
+    m_zerocopy_size = zerocopy_size;
+    m_limits = limits;
 }
 
 void WebServer::trig_mode()
@@ -91,10 +108,29 @@ void WebServer::sql_pool()
     users->initmysql_result(m_connPool);
 }
 
+void WebServer::cache_pool()
+{
+    //单个文件超过缓存的1/8时不缓存，避免一个大文件挤掉所有小文件
+    size_t max_bytes = (size_t)m_cache_size << 20;
+    file_cache::get_instance()->init(m_root, max_bytes, max_bytes / 8, m_close_log);
+    //登录注册用到的模板页面在启动时编译
+    template_registry::get_instance()->init(m_root, http_conn::template_pages, http_conn::TEMPLATE_PAGE_COUNT,
+                                            m_close_log);
+    m_inotifyfd = file_cache::get_instance()->inotify_fd();
+    //资源包加载失败时退回到直接读取网站目录
+    if (!m_bundle_path.empty())
+        file_cache::get_instance()->open_bundle(m_bundle_path.c_str());
+    if (!cache_policy::get_instance()->init(m_cache_rules.c_str()))
+        LOG_ERROR("ignored malformed cache rules: %s", m_cache_rules.c_str());
+    //冷文件的磁盘读交给预读线程
+    if (io_pool::get_instance()->init(m_io_threads, m_close_log))
+        m_iofd = io_pool::get_instance()->notify_fd();
+}
+
 void WebServer::thread_pool()
 {
     //线程池
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    m_pool = new threadpool<http_conn>(m_actormodel, m_thread_num, 10000, m_sched_mode, m_max_thread_num);
 }
 
 void WebServer::eventListen()
@@ -148,6 +184,16 @@ void WebServer::eventListen()
     //将lfd上树
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
     http_conn::m_epollfd = m_epollfd;
+    http_conn::m_upload_threshold = m_upload_threshold;
+    http_conn::m_sendfile = (1 == m_send_mode);
+    http_conn::m_prerender_size = m_prerender_size;
+    http_conn::m_zerocopy_threshold = m_zerocopy_size > 0 ? (size_t)m_zerocopy_size << 10 : 0;
+    //请求头只能在读缓冲区内解析
+    if (m_limits.max_header_size <= 0 || m_limits.max_header_size >= http_conn::READ_BUFFER_SIZE)
+        m_limits.max_header_size = http_conn::READ_BUFFER_SIZE - 1;
+    if (m_limits.max_body_size < 0)
+        m_limits.max_body_size = 0;
+    http_conn::m_limits = m_limits;
 
     //创建管道套接字
     socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
@@ -161,6 +207,13 @@ void WebServer::eventListen()
     //设置管道读端为LT非阻塞 统一事件源
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
 
+    //文件缓存的inotify事件同样由主循环处理
+    if (m_inotifyfd != -1)
+        utils.addfd(m_epollfd, m_inotifyfd, false, 0);
+    //预读完成通知
+    if (m_iofd != -1)
+        utils.addfd(m_epollfd, m_iofd, false, 0);
+
     utils.addsig(SIGPIPE, SIG_IGN);     //忽略SIGPIPE信号
 
     //传递给主循环的信号值，这里只关注SIGALRM和SIGTERM(处理：仅发送到管道)
@@ -182,25 +235,22 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address)
     users[connfd].init(connfd, client_address, m_root, m_CONNTrigmode, m_close_log, m_user, m_passWord, m_databaseName);
     
     //初始化client_data数据
-    //创建定时器，设置回调函数和超时时间，绑定用户数据，将定时器添加到链表中
+    //定时器嵌入在client_data中，设置回调函数和超时时间，绑定用户数据，将定时器加入时间轮
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
-    util_timer *timer = new util_timer;
+    util_timer *timer = &users_timer[connfd].timer;
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3*TIMESLOT;
-    users_timer[connfd].timer = timer;
-    utils.m_timer_lst.add_timer(timer);
+    timer->expire = users[connfd].deadline(coarse_clock::get_instance()->now_ms());
+    utils.m_timer_wheel.add_timer(timer);
 }
 
-//若有数据传输，则将定时器往后延迟3个单位
-//并对新的定时器在链表上的位置进行调整
+//处理完读写事件后按连接所处的阶段重新计算超时时间
+//并将定时器移到时间轮中新的位置
 void WebServer::adjust_timer(util_timer *timer)
 {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
-    utils.m_timer_lst.add_timer(timer);
+    timer->expire = users[timer->user_data->sockfd].deadline(coarse_clock::get_instance()->now_ms());
+    utils.m_timer_wheel.adjust_timer(timer);
 
     LOG_INFO("%s", "adjust timer once");
 }
@@ -210,7 +260,7 @@ void WebServer::deal_timer(util_timer *timer, int sockfd)
     timer->cb_func(&users_timer[sockfd]);
     if (timer)
     {
-        utils.m_timer_lst.del_timer(timer);
+        utils.m_timer_wheel.del_timer(timer);
     }
     LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
 }
@@ -260,6 +310,30 @@ bool WebServer::dealclientdata()
     return true;
 }
 
+//预读完成的连接重新注册写事件，主循环随后继续发送
+//通知管道是LT模式，一次处理不完的下一轮继续
+void WebServer::dealwithprefetch()
+{
+    io_done done[64];
+    int n = io_pool::get_instance()->completed(done, 64);
+    for (int i = 0; i < n; ++i)
+        users[done[i].sockfd].resume_write(done[i].ticket);
+}
+
+//零拷贝发送的完成通知经错误队列以EPOLLERR报告，取走后同一事件中的读写照常处理
+//EPOLLONESHOT已被这次事件消耗，没有读写要处理时重新注册
+void WebServer::dealwithzerocopy(int sockfd, uint32_t events)
+{
+    if (events & (EPOLLRDHUP | EPOLLHUP))
+        deal_timer(&users_timer[sockfd].timer, sockfd);
+    else if (events & EPOLLIN)
+        dealwithread(sockfd);
+    else if (events & EPOLLOUT)
+        dealwithwrite(sockfd);
+    else
+        users[sockfd].rearm();
+}
+
 bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
 {
     int ret = 0;
@@ -301,7 +375,7 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server)
 
 void WebServer::dealwithread(int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    util_timer *timer = &users_timer[sockfd].timer;
 
     //reactor
     if (1 == m_actormodel)
@@ -334,13 +408,27 @@ void WebServer::dealwithread(int sockfd)
         if (users[sockfd].read_once())
         {
             LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
-            //读完成事件，将该事件放入请求队列
-            m_pool->append_p(users + sockfd);
-
             if (timer)
             {
                 adjust_timer(timer);
             }
+
+            //缓存命中的静态请求在主线程上直接生成应答并发送，省去两次线程切换
+            //其余请求放入请求队列，由工作线程处理
+            switch (users[sockfd].process_inline())
+            {
+            case http_conn::INLINE_DEFER:
+                m_pool->append_p(users + sockfd);
+                break;
+            case http_conn::INLINE_WRITE:
+                dealwithwrite(sockfd);
+                break;
+            case http_conn::INLINE_CLOSE:
+                deal_timer(timer, sockfd);
+                break;
+            default:
+                break;
+            }
         }
         else
         {
@@ -351,7 +439,7 @@ void WebServer::dealwithread(int sockfd)
 
 void WebServer::dealwithwrite(int sockfd)
 {
-    util_timer *timer = users_timer[sockfd].timer;
+    util_timer *timer = &users_timer[sockfd].timer;
 
     //reactor
     if (1 == m_actormodel)
@@ -405,6 +493,8 @@ void WebServer::eventLoop()
     {
         //监测发生事件的文件描述符(阻塞)
         int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        //本轮处理的事件共用同一个时间，定时器、日志和Date头部都读取缓存的值
+        coarse_clock::get_instance()->update();
         //回调函数会打断accpet阻塞，导致主进程提前终止，为了避免此情况，跳过EINTR错误
         if (number < 0 && errno != EINTR)
         {
@@ -424,10 +514,14 @@ void WebServer::eventLoop()
                 if(false == flag)
                     continue;
             }
+            else if ((events[i].events & EPOLLERR) && users[sockfd].reap_zerocopy())
+            {
+                dealwithzerocopy(sockfd, events[i].events);
+            }
             else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
                 //服务器端关闭连接，移除对应的定时器
-                util_timer *timer = users_timer[sockfd].timer;
+                util_timer *timer = &users_timer[sockfd].timer;
                 deal_timer(timer, sockfd);
             }
             else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN))
@@ -440,6 +534,15 @@ void WebServer::eventLoop()
                 if (false == flag)
                     LOG_ERROR("%s", "dealclientdata failure");
             }
+            //网站目录下的文件发生变化，使缓存失效
+            else if ((sockfd == m_inotifyfd) && (events[i].events & EPOLLIN))
+            {
+                file_cache::get_instance()->handle_events();
+            }
+            else if ((sockfd == m_iofd) && (events[i].events & EPOLLIN))
+            {
+                dealwithprefetch();
+            }
             //处理客户连接上接收到的数据
             else if (events[i].events & EPOLLIN)
             {
@@ -453,6 +556,8 @@ void WebServer::eventLoop()
         if (timeout)
         {
             utils.timer_handler();
+            //没有新请求入队时也要按时检查线程池是否需要伸缩
+            m_pool->balance();
 
             LOG_INFO("%s", "timer tick");
 
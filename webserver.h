@@ -18,7 +18,7 @@
 
 const int MAX_FD = 65536;           //最大文件描述符
 const int MAX_EVENT_NUMBER = 10000; //最大事件数
-const int TIMESLOT = 5;             //最小超时单位
+const int TIMESLOT = 1;             //时间轮前进的间隔，即超时的精度
 
 class WebServer
 {
@@ -28,11 +28,16 @@ public:
 
     void init(int port, string user,string passWord,string databaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, int upload_threshold,
+              int cache_size, int send_mode, int prerender_size, string cache_rules,
+              int io_threads, string bundle_path, int zerocopy_size, int sched_mode,
+              int max_thread_num, const conn_limits &limits);
     //线程池函数
     void thread_pool(); 
     //数据库池函数
     void sql_pool();    
+    //静态文件缓存
+    void cache_pool();
     void log_write(); 
     //更改模式  
     void trig_mode();  
@@ -54,6 +59,9 @@ public:
     void dealwithread(int sockfd);
     //处理写事件
     void dealwithwrite(int sockfd);
+    //处理预读完成通知
+    void dealwithprefetch();
+    void dealwithzerocopy(int sockfd, uint32_t events);
 public:
     //基础
     //监听端口
@@ -64,6 +72,26 @@ public:
     int m_close_log;
     //触发模式
     int m_actormodel;
+    //请求体转存临时文件的阈值
+    int m_upload_threshold;
+    //静态文件缓存大小(MB)及其inotify描述符
+    int m_cache_size;
+    int m_inotifyfd;
+    //文件发送方式，0为mmap+writev，1为sendfile
+    int m_send_mode;
+    //缓存完整应答的小文件大小上限
+    int m_prerender_size;
+    //Cache-Control规则
+    string m_cache_rules;
+    //磁盘预读线程数量及其完成通知描述符
+    int m_io_threads;
+    int m_iofd;
+    //静态资源包路径
+    string m_bundle_path;
+    //零拷贝发送的应答体大小下限，单位KB
+    int m_zerocopy_size;
+    //各阶段的超时与请求头限制
+    conn_limits m_limits;
 
     //进程通信模块
     int m_pipefd[2];
@@ -83,6 +111,8 @@ public:
     //http线程池
     threadpool<http_conn> *m_pool;
     int m_thread_num;
+    int m_sched_mode;
+    int m_max_thread_num;
 
     //epoll_event 注册节点事件  
     epoll_event events[MAX_EVENT_NUMBER];